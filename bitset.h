@@ -0,0 +1,289 @@
+/*
+bitset.h
+--------
+Defines the public API for a compact set of flags stored one bit each, and a
+basic implementation.
+
+To include the implementation with this header file, define
+QML_BITSET_IMPLEMENTATION beforehand:
+
+  #define QML_BITSET_IMPLEMENTATION
+  #include "bitset.h"
+
+Basic usage:
+
+  // room for a million flags in 125KiB, all of them clear
+  bitset_t seen = bitset_alloc(1000000);
+  bitset_set(&seen, 42);
+  bitset_set(&seen, 1000);
+  if(bitset_test(&seen, 42))
+    printf("%zu flags before 42 are set\n", bitset_rank(&seen, 42));
+  // visit every set flag, skipping 64 clear ones at a time
+  for(size_t i = bitset_find_next(&seen, 0); i < seen.len;
+      i = bitset_find_next(&seen, i+1))
+    printf("%zu\n", i);
+
+  // combine whole sets at once, word by word
+  bitset_and(&seen, &wanted);
+  bitset_free(&seen);
+
+Customising behavior:
+
+  // You can pick and choose which functions will be used for memory management.
+  // These are expected to have the exact signatures of the stdlib functions
+  // malloc, realloc and free respectively.
+  #define QML_ALLOC my_alloc
+  #define QML_REALLOC my_realloc
+  #define QML_FREE my_free
+
+  // If defined, bulk operations always go one 64 bit word at a time, instead of
+  // four at a time with AVX2 where it's available.
+  #define QML_BITSET_NO_SIMD
+
+*/
+
+#ifndef QML_BITSET_DEFINED
+#define QML_BITSET_DEFINED
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct bitset {
+  // Number of flags in the set.
+  size_t    len;
+  // Number of 64 bit words allocated.
+  size_t    cap;
+  uint64_t *words;
+} bitset_t;
+
+// Allocate a set of len flags, all of them clear.
+bitset_t bitset_alloc(size_t len);
+// Set the flag at the given index, growing the set with clear flags if the
+// index is out of bounds.
+void bitset_set(bitset_t *bits, size_t idx);
+// Clear the flag at the given index. Does nothing if the index is out of
+// bounds.
+void bitset_clear(bitset_t *bits, size_t idx);
+// Returns 1 if the flag at the given index is set, or 0 if it is clear or the
+// index is out of bounds.
+int bitset_test(bitset_t *bits, size_t idx);
+// Append a flag to the end of the set, expanding it if necessary.
+void bitset_append(bitset_t *bits, int value);
+// Change the number of flags in the set. Flags added at the end are clear.
+void bitset_resize(bitset_t *bits, size_t len);
+// Get the number of set flags.
+size_t bitset_count(bitset_t *bits);
+// Get the number of set flags before the given index.
+size_t bitset_rank(bitset_t *bits, size_t idx);
+// Get the index of the first set flag at or after the given index, or the
+// set's length if there is none.
+size_t bitset_find_next(bitset_t *bits, size_t idx);
+// Keep only the flags that are set in both dst and src. Flags past the end of
+// src are cleared.
+void bitset_and(bitset_t *dst, bitset_t *src);
+// Set every flag in dst that is set in src. Flags past the end of dst are
+// ignored.
+void bitset_or(bitset_t *dst, bitset_t *src);
+// Flip every flag in dst that is set in src. Flags past the end of dst are
+// ignored.
+void bitset_xor(bitset_t *dst, bitset_t *src);
+// Clear every flag in dst that is set in src.
+void bitset_andnot(bitset_t *dst, bitset_t *src);
+// Frees the set's allocated memory and sets it as empty.
+void bitset_free(bitset_t *bits);
+
+#endif // QML_BITSET_DEFINED
+
+#ifdef QML_BITSET_IMPLEMENTATION
+
+#include <string.h>
+
+#ifndef QML_ALLOC
+#include <stdlib.h>
+#define QML_ALLOC malloc
+#endif
+
+#ifndef QML_REALLOC
+#include <stdlib.h>
+#define QML_REALLOC realloc
+#endif
+
+#ifndef QML_FREE
+#include <stdlib.h>
+#define QML_FREE free
+#endif
+
+#if defined(__AVX2__) && !defined(QML_BITSET_NO_SIMD)
+#include <immintrin.h>
+#define _BITSET_AVX2
+#endif
+
+#define _BITSET_WORDS(len) (((len) + 63) / 64)
+
+static inline unsigned _bitset_popcount(uint64_t word) {
+  return (unsigned)__builtin_popcountll(word);
+}
+
+// Clears the unused bits of the last word, so that whole words can be counted
+// and searched.
+static inline void _bitset_trim(bitset_t *bits) {
+  if(bits->len % 64 != 0)
+    bits->words[bits->len / 64] &= ((uint64_t)1 << (bits->len % 64)) - 1;
+}
+
+bitset_t bitset_alloc(size_t len) {
+  size_t cap = _BITSET_WORDS(len);
+  if(cap == 0)
+    cap = 1;
+  uint64_t *words = (uint64_t *)QML_ALLOC(sizeof(uint64_t)*cap);
+  memset(words, 0, sizeof(uint64_t)*cap);
+  return (bitset_t){ len, cap, words };
+}
+
+void bitset_resize(bitset_t *bits, size_t len) {
+  size_t used = _BITSET_WORDS(bits->len), need = _BITSET_WORDS(len);
+  if(need > bits->cap) {
+    size_t cap = bits->cap + bits->cap/2;
+    if(cap < need)
+      cap = need;
+    bits->words = (uint64_t *)QML_REALLOC(bits->words, sizeof(uint64_t)*cap);
+    bits->cap = cap;
+  }
+  if(need > used)
+    memset(bits->words + used, 0, sizeof(uint64_t)*(need - used));
+  bits->len = len;
+  _bitset_trim(bits);
+}
+
+void bitset_set(bitset_t *bits, size_t idx) {
+  if(idx >= bits->len)
+    bitset_resize(bits, idx+1);
+  bits->words[idx / 64] |= (uint64_t)1 << (idx % 64);
+}
+
+void bitset_clear(bitset_t *bits, size_t idx) {
+  if(idx >= bits->len)
+    return;
+  bits->words[idx / 64] &= ~((uint64_t)1 << (idx % 64));
+}
+
+int bitset_test(bitset_t *bits, size_t idx) {
+  if(idx >= bits->len)
+    return 0;
+  return (bits->words[idx / 64] >> (idx % 64)) & 1;
+}
+
+void bitset_append(bitset_t *bits, int value) {
+  size_t idx = bits->len;
+  bitset_resize(bits, idx+1);
+  if(value)
+    bits->words[idx / 64] |= (uint64_t)1 << (idx % 64);
+}
+
+size_t bitset_count(bitset_t *bits) {
+  size_t count = 0;
+  for(size_t i = 0; i < _BITSET_WORDS(bits->len); i++)
+    count += _bitset_popcount(bits->words[i]);
+  return count;
+}
+
+size_t bitset_rank(bitset_t *bits, size_t idx) {
+  if(idx > bits->len)
+    idx = bits->len;
+  size_t count = 0;
+  for(size_t i = 0; i < idx / 64; i++)
+    count += _bitset_popcount(bits->words[i]);
+  if(idx % 64 != 0)
+    count += _bitset_popcount(bits->words[idx / 64]
+                              & (((uint64_t)1 << (idx % 64)) - 1));
+  return count;
+}
+
+size_t bitset_find_next(bitset_t *bits, size_t idx) {
+  if(idx >= bits->len)
+    return bits->len;
+  size_t word = idx / 64;
+  // ignore the flags before idx in it's own word
+  uint64_t rest = bits->words[word] & (~(uint64_t)0 << (idx % 64));
+  size_t words = _BITSET_WORDS(bits->len);
+  while(rest == 0) {
+    if(++word == words)
+      return bits->len;
+    rest = bits->words[word];
+  }
+  return word*64 + (size_t)__builtin_ctzll(rest);
+}
+
+// Bulk operations
+//
+// These go over both sets' words at once, four at a time with AVX2. op is the
+// operation on two 64 bit words, and simd_op the matching AVX2 intrinsic.
+
+#ifdef _BITSET_AVX2
+#define _BITSET_BULK(dst, src, words, op, simd_op)                             \
+  do {                                                                         \
+    size_t _i = 0;                                                             \
+    for(; _i + 4 <= (words); _i += 4) {                                        \
+      __m256i _d = _mm256_loadu_si256((const __m256i *)((dst) + _i));          \
+      __m256i _s = _mm256_loadu_si256((const __m256i *)((src) + _i));          \
+      _mm256_storeu_si256((__m256i *)((dst) + _i), simd_op(_d, _s));           \
+    }                                                                          \
+    for(; _i < (words); _i++)                                                  \
+      (dst)[_i] = op((dst)[_i], (src)[_i]);                                    \
+  } while(0)
+#else
+#define _BITSET_BULK(dst, src, words, op, simd_op)                             \
+  do {                                                                         \
+    for(size_t _i = 0; _i < (words); _i++)                                     \
+      (dst)[_i] = op((dst)[_i], (src)[_i]);                                    \
+  } while(0)
+#endif
+
+#define _BITSET_AND(a, b)    ((a) & (b))
+#define _BITSET_OR(a, b)     ((a) | (b))
+#define _BITSET_XOR(a, b)    ((a) ^ (b))
+#define _BITSET_ANDNOT(a, b) ((a) & ~(b))
+// _mm256_andnot_si256 negates it's first argument
+#define _BITSET_MM_ANDNOT(a, b) _mm256_andnot_si256(b, a)
+
+// Number of words both sets have in use.
+static inline size_t _bitset_common(bitset_t *dst, bitset_t *src) {
+  size_t a = _BITSET_WORDS(dst->len), b = _BITSET_WORDS(src->len);
+  return a < b ? a : b;
+}
+
+void bitset_and(bitset_t *dst, bitset_t *src) {
+  size_t common = _bitset_common(dst, src);
+  _BITSET_BULK(dst->words, src->words, common, _BITSET_AND, _mm256_and_si256);
+  size_t words = _BITSET_WORDS(dst->len);
+  if(words > common)
+    memset(dst->words + common, 0, sizeof(uint64_t)*(words - common));
+}
+
+void bitset_or(bitset_t *dst, bitset_t *src) {
+  size_t common = _bitset_common(dst, src);
+  _BITSET_BULK(dst->words, src->words, common, _BITSET_OR, _mm256_or_si256);
+  _bitset_trim(dst);
+}
+
+void bitset_xor(bitset_t *dst, bitset_t *src) {
+  size_t common = _bitset_common(dst, src);
+  _BITSET_BULK(dst->words, src->words, common, _BITSET_XOR, _mm256_xor_si256);
+  _bitset_trim(dst);
+}
+
+void bitset_andnot(bitset_t *dst, bitset_t *src) {
+  size_t common = _bitset_common(dst, src);
+  _BITSET_BULK(dst->words, src->words, common, _BITSET_ANDNOT,
+               _BITSET_MM_ANDNOT);
+}
+
+void bitset_free(bitset_t *bits) {
+  if(bits->words != NULL)
+    QML_FREE(bits->words);
+  bits->words = NULL;
+  bits->len = 0;
+  bits->cap = 0;
+}
+
+#endif // QML_BITSET_IMPLEMENTATION
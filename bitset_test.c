@@ -0,0 +1,144 @@
+#define QML_BITSET_IMPLEMENTATION
+#include "bitset.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// xorshift, so that every run checks the same flags
+uint32_t next_rand(uint32_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}
+
+// Checks the set holds the same flags as the array of len bytes, through
+// bitset_test, bitset_count, bitset_rank and bitset_find_next.
+int bitset_equals(bitset_t *bits, const unsigned char *want, size_t len) {
+  int ok = bits->len == len;
+  size_t count = 0, next = len;
+  for(size_t i = len; ok && i-- > 0;) {
+    if(want[i])
+      next = i;
+    ok = bitset_test(bits, i) == want[i] && bitset_find_next(bits, i) == next;
+  }
+  for(size_t i = 0; ok && i <= len; i++) {
+    ok = bitset_rank(bits, i) == count;
+    count += i < len && want[i];
+  }
+  return ok && bitset_count(bits) == count && !bitset_test(bits, len);
+}
+
+// Fills a set and an array of len bytes with the same random flags, through
+// bitset_set, bitset_clear and bitset_append.
+bitset_t random_bits(unsigned char *want, size_t len, uint32_t *state) {
+  bitset_t bits = bitset_alloc(len / 2);
+  for(size_t i = 0; i < len; i++)
+    want[i] = next_rand(state) % 3 == 0;
+  for(size_t i = 0; i < len / 2; i++) {
+    if(want[i])
+      bitset_set(&bits, i);
+    else if(next_rand(state) % 2)
+      bitset_clear(&bits, i);
+  }
+  for(size_t i = len / 2; i < len; i++)
+    bitset_append(&bits, want[i]);
+  return bits;
+}
+
+// Compares every bulk operation between sets of different lengths, none of
+// them a multiple of 256 and most not a multiple of 64, against the same
+// operation done byte by byte. Then shrinks and grows a set, checking the
+// flags that come back are clear.
+int check_against_bytes(void) {
+  const size_t lens[] = { 0, 1, 63, 64, 65, 200, 257, 511, 1000, 1345 };
+  const size_t count = sizeof(lens)/sizeof(lens[0]);
+  unsigned char *a = malloc(2000), *b = malloc(2000), *want = malloc(2000);
+  uint32_t state = 2463534242u;
+  int ok = 1;
+
+  for(size_t x = 0; x < count; x++) {
+    for(size_t y = 0; y < count; y++) {
+      for(int op = 0; op < 4; op++) {
+        size_t a_len = lens[x], b_len = lens[y];
+        bitset_t dst = random_bits(a, a_len, &state);
+        bitset_t src = random_bits(b, b_len, &state);
+        ok = ok && bitset_equals(&dst, a, a_len)
+          && bitset_equals(&src, b, b_len);
+        for(size_t i = 0; i < a_len; i++) {
+          int other = i < b_len && b[i];
+          want[i] = op == 0 ? a[i] && other : op == 1 ? a[i] || other
+            : op == 2 ? a[i] != other : a[i] && !other;
+        }
+        if(op == 0)
+          bitset_and(&dst, &src);
+        else if(op == 1)
+          bitset_or(&dst, &src);
+        else if(op == 2)
+          bitset_xor(&dst, &src);
+        else
+          bitset_andnot(&dst, &src);
+        // src is never changed
+        ok = ok && bitset_equals(&dst, want, a_len)
+          && bitset_equals(&src, b, b_len);
+        bitset_free(&dst);
+        bitset_free(&src);
+      }
+    }
+  }
+
+  // shrinking drops the flags past the end, growing again leaves them clear
+  bitset_t bits = random_bits(a, 1345, &state);
+  bitset_set(&bits, 1344);
+  a[1344] = 1;
+  bitset_resize(&bits, 70);
+  ok = ok && bitset_equals(&bits, a, 70) && !bitset_test(&bits, 1344);
+  bitset_resize(&bits, 1345);
+  memset(a + 70, 0, 1345 - 70);
+  ok = ok && bitset_equals(&bits, a, 1345);
+  // clearing past the end does nothing, setting past it grows the set
+  bitset_clear(&bits, 1500);
+  ok = ok && bits.len == 1345;
+  bitset_set(&bits, 1999);
+  memset(a + 1345, 0, 1999 - 1345);
+  a[1999] = 1;
+  ok = ok && bitset_equals(&bits, a, 2000);
+  bitset_free(&bits);
+
+  free(a);
+  free(b);
+  free(want);
+  return ok;
+}
+
+int main(void) {
+  // flag every multiple of 3 and every multiple of 5 below a million
+  bitset_t threes = bitset_alloc(1000000), fives = bitset_alloc(1000000);
+  for(size_t i = 0; i < threes.len; i += 3)
+    bitset_set(&threes, i);
+  for(size_t i = 0; i < fives.len; i += 5)
+    bitset_set(&fives, i);
+  printf("Flags take up %zu bytes per set.\n", threes.cap * sizeof(uint64_t));
+
+  // the multiples of both are the multiples of 15
+  bitset_t both = bitset_alloc(1000000);
+  bitset_or(&both, &threes);
+  bitset_and(&both, &fives);
+  size_t count = bitset_count(&both);
+  printf("%zu multiples of 15 below a million.\n", count);
+
+  // the 100th multiple of 15 comes right after 99 others
+  size_t hundredth = 0;
+  for(int i = 0; i < 100; i++)
+    hundredth = bitset_find_next(&both, i == 0 ? 0 : hundredth+1);
+  size_t rank = bitset_rank(&both, hundredth);
+  printf("The 100th is %zu, with %zu before it.\n", hundredth, rank);
+
+  bitset_free(&threes);
+  bitset_free(&fives);
+  bitset_free(&both);
+
+  int same = check_against_bytes();
+  printf("Every operation agrees with a byte array: %s\n", same ? "yes" : "no");
+  return count != 66667 || hundredth != 1485 || rank != 99 || !same;
+}
@@ -0,0 +1,8 @@
+// Compiles the flex_buf.h implementation in C, for C++ programs that use
+// flex_buf.hpp:
+//
+//   cc -c flex_buf.c
+//   c++ -std=c++17 flex_buf_test.cpp flex_buf.o
+//   c++ -std=c++17 -O2 flex_buf_bench.cpp flex_buf.o
+#define QML_FLEXBUF_IMPLEMENTATION
+#include "flex_buf.h"
@@ -41,6 +41,31 @@ Customising behavior:
   // or
   #define QML_FLEXBUF_FREE_ON_FINALISE
 
+  // Buffers allocated with buf_alloc_aligned that are aligned to a huge page
+  // and at least this many bytes large are marked with madvise(MADV_HUGEPAGE)
+  // on Linux. Defaults to the size of a single huge page. This requires
+  // compiling with _DEFAULT_SOURCE (or _GNU_SOURCE) defined, a strict C99
+  // build leaves the hint out.
+  #define QML_HUGEPAGE_THRESHOLD (4*1024*1024)
+
+Aligned storage:
+
+  // data will be aligned to a cache line, and will stay aligned when the
+  // buffer grows or shrinks
+  flex_buf_t my_buf = buf_alloc_aligned(4096, QML_ALIGN_CACHE_LINE);
+
+Binary encoding:
+
+  flex_buf_t msg = buf_alloc(64);
+  buf_put_u32le(&msg, 0xC0FFEE);       // fixed-width little-endian integers
+  buf_put_varint(&msg, 300);           // LEB128 varint, 2 bytes here
+  buf_put_svarint(&msg, -3);           // zigzag varint, 1 byte here
+  buf_put_blob(&msg, "hi", 2);         // varint length followed by the bytes
+  buf_reader_t rd = buf_reader(&msg);  // read it all back, checking bounds
+  uint32_t magic;
+  if(!buf_get_u32le(&rd, &magic))
+    // the message was truncated
+
 qeaml 9.11.2022
 */
 
@@ -48,14 +73,36 @@ qeaml 9.11.2022
 #define QML_FLEXBUF_DEFINED
 
 #include <stddef.h>
+#include <stdint.h>
+
+#ifndef QML_ALIGN_CACHE_LINE
+// Alignment of a single cache line. Buffers written to by different threads
+// should be aligned to this to avoid false sharing.
+#define QML_ALIGN_CACHE_LINE 64
+#endif
+
+#ifndef QML_ALIGN_HUGE_PAGE
+// Alignment of a single (transparent) huge page.
+#define QML_ALIGN_HUGE_PAGE (2*1024*1024)
+#endif
 
 typedef struct flex_buf {
   size_t  size, cap;
     char *data;
+  // Alignment of the data in bytes, or 0 if it was allocated with QML_ALLOC
+  // directly.
+  size_t  align;
 } flex_buf_t;
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 // Allocate a buffer on the heap with size 0 and the given capacity.
 flex_buf_t buf_alloc(size_t cap);
+// Allocate a buffer like buf_alloc, but with it's data aligned to the given
+// power of two. The alignment is kept when the buffer is grown or shrunk.
+flex_buf_t buf_alloc_aligned(size_t cap, size_t align);
 // Append a single character to the buffer, growing it if necessary.
 void buf_append(flex_buf_t *buf, char c);
 // Append n characters to the buffer, growing it if necessary.
@@ -64,6 +111,9 @@ void buf_append_n(flex_buf_t *buf, char *src, size_t amt);
 void buf_append_cstr(flex_buf_t *buf, char *str);
 // Concatenate the other buffer to this buffer, growing it if necessary.
 void buf_concat(flex_buf_t *buf, flex_buf_t other);
+// Grow the buffer, if necessary, so that at least amt more characters can be
+// appended without it growing again.
+void buf_reserve(flex_buf_t *buf, size_t amt);
 // Shrink the capacity of this buffer to it's current size and reallocate the
 // underlying memory to this new, smaller capacity.
 void buf_shrink(flex_buf_t *buf);
@@ -74,13 +124,55 @@ void buf_finalize(flex_buf_t *buf, char *out);
 // NULL.
 void buf_free(flex_buf_t *buf);
 
+// Append a 16-bit unsigned integer in little-endian byte order.
+void buf_put_u16le(flex_buf_t *buf, uint16_t val);
+// Append a 32-bit unsigned integer in little-endian byte order.
+void buf_put_u32le(flex_buf_t *buf, uint32_t val);
+// Append a 64-bit unsigned integer in little-endian byte order.
+void buf_put_u64le(flex_buf_t *buf, uint64_t val);
+// Append an unsigned integer as a LEB128 variable-length integer, taking up
+// between 1 and 10 bytes.
+void buf_put_varint(flex_buf_t *buf, uint64_t val);
+// Append a signed integer as a zigzag-encoded varint, so that numbers close to
+// 0 take up few bytes no matter the sign.
+void buf_put_svarint(flex_buf_t *buf, int64_t val);
+// Append amt bytes of src prefixed with amt as a varint.
+void buf_put_blob(flex_buf_t *buf, char *src, size_t amt);
+
+// A cursor reading back data written by the buf_put_* functions. It does not
+// own the data it reads from.
+typedef struct buf_reader {
+  size_t       pos, size;
+  const char *data;
+} buf_reader_t;
+
+// Create a reader over the buffer's current contents.
+buf_reader_t buf_reader(flex_buf_t *buf);
+// Each of the buf_get_* functions reads a value written by the matching
+// buf_put_* function and advances the reader past it. They return 1 on success
+// and 0 if the value is truncated or malformed, in which case the reader is
+// left untouched.
+int buf_get_u16le(buf_reader_t *rd, uint16_t *out);
+int buf_get_u32le(buf_reader_t *rd, uint32_t *out);
+int buf_get_u64le(buf_reader_t *rd, uint64_t *out);
+int buf_get_varint(buf_reader_t *rd, uint64_t *out);
+int buf_get_svarint(buf_reader_t *rd, int64_t *out);
+// Reads a blob written with buf_put_blob. The output pointer points into the
+// reader's data, nothing is copied.
+int buf_get_blob(buf_reader_t *rd, const char **out, size_t *amt);
+
 // UK-friendly
 #define buf_finalise buf_finalize
 #define buf_append_lit(buf, lit) buf_append_n(buf, lit, sizeof(lit)-1)
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif // QML_FLEXBUF_DEFINED
 
-#ifdef QML_FLEXBUF_IMPLEMENTATION
+#if defined(QML_FLEXBUF_IMPLEMENTATION) && !defined(QML_FLEXBUF_IMPLEMENTED)
+#define QML_FLEXBUF_IMPLEMENTED
 
 #include <string.h>
 
@@ -99,20 +191,79 @@ void buf_free(flex_buf_t *buf);
 #define QML_FREE free
 #endif
 
+#ifndef QML_HUGEPAGE_THRESHOLD
+#define QML_HUGEPAGE_THRESHOLD QML_ALIGN_HUGE_PAGE
+#endif
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+// Allocates size bytes aligned to align using QML_ALLOC. The pointer returned
+// by QML_ALLOC is stored right before the aligned data, so that it can be
+// given back to QML_FREE later.
+static char *_buf_aligned_alloc(size_t size, size_t align) {
+  if(align < sizeof(void*))
+    align = sizeof(void*);
+  char *base = (char *)QML_ALLOC(size + align - 1 + sizeof(void*));
+  if(base == NULL)
+    return NULL;
+  uintptr_t addr = (uintptr_t)(base + sizeof(void*));
+  addr = (addr + align - 1) & ~(uintptr_t)(align - 1);
+  ((void **)addr)[-1] = base;
+
+  // MADV_HUGEPAGE is only visible with _DEFAULT_SOURCE or _GNU_SOURCE
+  #if defined(__linux__) && defined(MADV_HUGEPAGE)
+    if(align >= QML_ALIGN_HUGE_PAGE && size >= QML_HUGEPAGE_THRESHOLD)
+      madvise((void *)addr, size, MADV_HUGEPAGE);
+  #endif
+
+  return (char *)addr;
+}
+
+static void _buf_aligned_free(char *data) {
+  QML_FREE(((void **)data)[-1]);
+}
+
+// Resizes the buffer's underlying memory to it's current capacity, keeping the
+// alignment if it has one.
+static void _buf_realloc(flex_buf_t *buf) {
+  if(buf->align == 0) {
+    buf->data = (char *)QML_REALLOC(buf->data, buf->cap);
+    return;
+  }
+
+  // like the realloc above, data becomes NULL if this fails
+  char *data = _buf_aligned_alloc(buf->cap, buf->align);
+  if(data != NULL && buf->data != NULL) {
+    memcpy(data, buf->data, buf->size < buf->cap ? buf->size : buf->cap);
+    _buf_aligned_free(buf->data);
+  }
+  buf->data = data;
+}
+
 flex_buf_t buf_alloc(size_t cap) {
-  return (flex_buf_t){ 0, cap, (char *)QML_ALLOC(cap) };
+  flex_buf_t buf = { 0, cap, (char *)QML_ALLOC(cap), 0 };
+  return buf;
+}
+
+flex_buf_t buf_alloc_aligned(size_t cap, size_t align) {
+  if(align == 0)
+    return buf_alloc(cap);
+  flex_buf_t buf = { 0, cap, _buf_aligned_alloc(cap, align), align };
+  return buf;
 }
 
-inline void _buf_maybe_grow(flex_buf_t* buf, size_t amt) {
+static inline void _buf_maybe_grow(flex_buf_t* buf, size_t amt) {
   #ifdef QML_FLEXBUF_ALLOW_AUTO_ALLOC
-    if(buf->cap == 0 || buf->data == NULL) {
-      *buf = buf_alloc(amt);
+    if(buf->data == NULL) {
+      *buf = buf_alloc_aligned(amt, buf->align);
     }
   #endif
 
   if(buf->size + amt >= buf->cap) {
     buf->cap += buf->cap/2 + amt;
-    buf->data = (char *)QML_REALLOC(buf->data, buf->cap);
+    _buf_realloc(buf);
   }
 }
 
@@ -132,9 +283,13 @@ void buf_append_cstr(flex_buf_t *buf, char *str) {
   buf_append_n(buf, str, amt);
 }
 
+void buf_reserve(flex_buf_t *buf, size_t amt) {
+  _buf_maybe_grow(buf, amt);
+}
+
 void buf_shrink(flex_buf_t *buf) {
   buf->cap = buf->size + 1;
-  buf->data = (char *)QML_REALLOC(buf->data, buf->cap);
+  _buf_realloc(buf);
 }
 
 void buf_finalize(flex_buf_t *buf, char *out) {
@@ -147,13 +302,152 @@ void buf_finalize(flex_buf_t *buf, char *out) {
 }
 
 void buf_free(flex_buf_t *buf) {
-  if(buf->cap == 0 || buf->data == NULL)
+  // an aligned buffer of no capacity still has memory to release
+  if(buf->data == NULL)
     return;
 
   buf->size = 0;
   buf->cap = 0;
-  QML_FREE(buf->data);
+  if(buf->align == 0)
+    QML_FREE(buf->data);
+  else
+    _buf_aligned_free(buf->data);
   buf->data = NULL;
 }
 
+// Byte order conversion for the fixed-width codec, a no-op on little-endian
+// targets.
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define _buf_le16(x) __builtin_bswap16(x)
+#define _buf_le32(x) __builtin_bswap32(x)
+#define _buf_le64(x) __builtin_bswap64(x)
+#else
+#define _buf_le16(x) (x)
+#define _buf_le32(x) (x)
+#define _buf_le64(x) (x)
+#endif
+
+// The fixed-width functions go through memcpy, which compilers turn into a
+// single unaligned store or load.
+
+void buf_put_u16le(flex_buf_t *buf, uint16_t val) {
+  _buf_maybe_grow(buf, sizeof(val));
+  val = _buf_le16(val);
+  memcpy(buf->data + buf->size, &val, sizeof(val));
+  buf->size += sizeof(val);
+}
+
+void buf_put_u32le(flex_buf_t *buf, uint32_t val) {
+  _buf_maybe_grow(buf, sizeof(val));
+  val = _buf_le32(val);
+  memcpy(buf->data + buf->size, &val, sizeof(val));
+  buf->size += sizeof(val);
+}
+
+void buf_put_u64le(flex_buf_t *buf, uint64_t val) {
+  _buf_maybe_grow(buf, sizeof(val));
+  val = _buf_le64(val);
+  memcpy(buf->data + buf->size, &val, sizeof(val));
+  buf->size += sizeof(val);
+}
+
+void buf_put_varint(flex_buf_t *buf, uint64_t val) {
+  // grow once for the longest possible encoding so the loop below does not
+  // need any capacity checks
+  _buf_maybe_grow(buf, 10);
+  char *out = buf->data + buf->size;
+  while(val >= 0x80) {
+    *out++ = (char)(val | 0x80);
+    val >>= 7;
+  }
+  *out++ = (char)val;
+  buf->size = out - buf->data;
+}
+
+void buf_put_svarint(flex_buf_t *buf, int64_t val) {
+  buf_put_varint(buf, ((uint64_t)val << 1) ^ (uint64_t)(val >> 63));
+}
+
+void buf_put_blob(flex_buf_t *buf, char *src, size_t amt) {
+  buf_put_varint(buf, amt);
+  _buf_maybe_grow(buf, amt);
+  memcpy(buf->data + buf->size, src, amt);
+  buf->size += amt;
+}
+
+buf_reader_t buf_reader(flex_buf_t *buf) {
+  buf_reader_t rd = { 0, buf->size, buf->data };
+  return rd;
+}
+
+int buf_get_u16le(buf_reader_t *rd, uint16_t *out) {
+  if(rd->size - rd->pos < sizeof(*out))
+    return 0;
+  memcpy(out, rd->data + rd->pos, sizeof(*out));
+  *out = _buf_le16(*out);
+  rd->pos += sizeof(*out);
+  return 1;
+}
+
+int buf_get_u32le(buf_reader_t *rd, uint32_t *out) {
+  if(rd->size - rd->pos < sizeof(*out))
+    return 0;
+  memcpy(out, rd->data + rd->pos, sizeof(*out));
+  *out = _buf_le32(*out);
+  rd->pos += sizeof(*out);
+  return 1;
+}
+
+int buf_get_u64le(buf_reader_t *rd, uint64_t *out) {
+  if(rd->size - rd->pos < sizeof(*out))
+    return 0;
+  memcpy(out, rd->data + rd->pos, sizeof(*out));
+  *out = _buf_le64(*out);
+  rd->pos += sizeof(*out);
+  return 1;
+}
+
+int buf_get_varint(buf_reader_t *rd, uint64_t *out) {
+  const unsigned char *in = (const unsigned char *)rd->data + rd->pos;
+  size_t left = rd->size - rd->pos;
+  // a varint is never longer than 10 bytes, so the bounds only need to be
+  // checked near the end of the data
+  size_t max = left < 10 ? left : 10;
+  uint64_t val = 0;
+  for(size_t i = 0; i < max; i++) {
+    // the 10th byte only holds the 64th bit, anything more would overflow
+    if(i == 9 && in[i] > 1)
+      return 0;
+    val |= (uint64_t)(in[i] & 0x7f) << (7*i);
+    if(in[i] < 0x80) {
+      // buf_put_varint never ends on a zero byte, so this is over-long
+      if(in[i] == 0 && i > 0)
+        return 0;
+      *out = val;
+      rd->pos += i+1;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int buf_get_svarint(buf_reader_t *rd, int64_t *out) {
+  uint64_t val;
+  if(!buf_get_varint(rd, &val))
+    return 0;
+  *out = (int64_t)(val >> 1) ^ -(int64_t)(val & 1);
+  return 1;
+}
+
+int buf_get_blob(buf_reader_t *rd, const char **out, size_t *amt) {
+  buf_reader_t tmp = *rd;
+  uint64_t len;
+  if(!buf_get_varint(&tmp, &len) || tmp.size - tmp.pos < len)
+    return 0;
+  *out = tmp.data + tmp.pos;
+  *amt = (size_t)len;
+  rd->pos = tmp.pos + len;
+  return 1;
+}
+
 #endif // QML_FLEXBUF_IMPLEMENTATION
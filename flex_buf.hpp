@@ -0,0 +1,144 @@
+/*
+flex_buf.hpp
+------------
+A C++ wrapper around flex_buf.h. The qml::flex_buf class owns a flex_buf_t and
+frees it when it goes out of scope. It can be moved but never copies
+implicitly, and every member function is an inline call to the matching C
+function, so it costs nothing over using flex_buf_t directly.
+
+Requires C++17. The spare capacity accessors additionally need C++20 for
+std::span.
+
+The implementation of flex_buf.h still has to be included in one of your
+translation units. It is easiest to do that from a C file, which is all
+flex_buf.c does:
+
+  #define QML_FLEXBUF_IMPLEMENTATION
+  #include "flex_buf.h"
+
+Basic usage:
+
+  qml::flex_buf my_buf(10);           // allocate a buffer of 10 characters
+  my_buf << "Hello" << ' ' << "world";
+  my_buf.append('!');
+  std::string_view str = my_buf;      // view the contents without copying
+  qml::flex_buf other = std::move(my_buf); // my_buf is now empty
+  qml::flex_buf copy = other.clone(); // copies have to be asked for
+
+  // write directly into the spare capacity, then mark it as used
+  other.reserve(64);
+  std::span<char> spare = other.spare();
+  size_t n = format_into(spare.data(), spare.size());
+  other.commit(n);
+
+*/
+
+#ifndef QML_FLEXBUF_HPP_DEFINED
+#define QML_FLEXBUF_HPP_DEFINED
+
+#include "flex_buf.h"
+#include <string_view>
+#include <utility>
+
+#if __cplusplus >= 202002L
+#include <span>
+#endif
+
+namespace qml {
+
+class flex_buf {
+public:
+  // Create an empty buffer without allocating anything.
+  flex_buf() noexcept : buf_{ 0, 0, nullptr, 0 } {}
+  // Allocate a buffer with the given capacity.
+  explicit flex_buf(size_t cap) : buf_(buf_alloc(cap)) {}
+  // Allocate a buffer with the given capacity and data alignment.
+  flex_buf(size_t cap, size_t align) : buf_(buf_alloc_aligned(cap, align)) {}
+  // Take ownership of an existing flex_buf_t.
+  explicit flex_buf(flex_buf_t raw) noexcept : buf_(raw) {}
+
+  ~flex_buf() { buf_free(&buf_); }
+
+  flex_buf(const flex_buf &) = delete;
+  flex_buf &operator=(const flex_buf &) = delete;
+
+  flex_buf(flex_buf &&other) noexcept : buf_(other.buf_) {
+    other.buf_ = { 0, 0, nullptr, other.buf_.align };
+  }
+
+  flex_buf &operator=(flex_buf &&other) noexcept {
+    if(this != &other) {
+      buf_free(&buf_);
+      buf_ = other.buf_;
+      other.buf_ = { 0, 0, nullptr, other.buf_.align };
+    }
+    return *this;
+  }
+
+  // Explicitly copy the buffer's contents into a new buffer of the same
+  // alignment.
+  flex_buf clone() const {
+    flex_buf out(buf_.size + 1, buf_.align);
+    out.append(view());
+    return out;
+  }
+
+  // Give up ownership of the underlying flex_buf_t, leaving this buffer empty.
+  flex_buf_t release() noexcept {
+    flex_buf_t raw = buf_;
+    buf_ = { 0, 0, nullptr, raw.align };
+    return raw;
+  }
+
+  flex_buf_t *get() noexcept { return &buf_; }
+  const flex_buf_t *get() const noexcept { return &buf_; }
+
+  char *data() noexcept { return buf_.data; }
+  const char *data() const noexcept { return buf_.data; }
+  size_t size() const noexcept { return buf_.size; }
+  size_t capacity() const noexcept { return buf_.cap; }
+  bool empty() const noexcept { return buf_.size == 0; }
+
+  // Forget the contents without releasing any memory.
+  void clear() noexcept { buf_.size = 0; }
+  void reserve(size_t amt) { buf_reserve(&buf_, amt); }
+  void shrink() { buf_shrink(&buf_); }
+
+  void append(char c) { buf_append(&buf_, c); }
+  void append(std::string_view str) {
+    buf_append_n(&buf_, const_cast<char *>(str.data()), str.size());
+  }
+
+  std::string_view view() const noexcept {
+    return std::string_view(buf_.data, buf_.size);
+  }
+  operator std::string_view() const noexcept { return view(); }
+
+#if __cplusplus >= 202002L
+  // The allocated but unused space after the contents. Anything written here
+  // becomes part of the buffer once commit is called.
+  std::span<char> spare() noexcept {
+    return std::span<char>(buf_.data + buf_.size, buf_.cap - buf_.size);
+  }
+#endif
+
+  // Mark amt characters of the spare capacity as used.
+  void commit(size_t amt) noexcept { buf_.size += amt; }
+
+  flex_buf &operator<<(char c) {
+    append(c);
+    return *this;
+  }
+
+  flex_buf &operator<<(std::string_view str) {
+    append(str);
+    return *this;
+  }
+
+private:
+  flex_buf_t buf_;
+};
+
+} // namespace qml
+
+#endif // QML_FLEXBUF_HPP_DEFINED
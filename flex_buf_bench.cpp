@@ -0,0 +1,68 @@
+// The implementation comes from flex_buf.c, link with it.
+#include "flex_buf.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+
+#define CHARS 50000000
+#define WORDS 10000000
+#define RUNS 5
+
+using namespace std::literals;
+
+static double now() {
+  auto t = std::chrono::steady_clock::now().time_since_epoch();
+  return std::chrono::duration<double>(t).count();
+}
+
+static void report(const char *name, double best) {
+  std::printf("%-26s %8.2f ms\n", name, best * 1e3);
+}
+
+// Appends the same characters and words through the C functions and through
+// qml::flex_buf, keeping the best of a few runs of each. Both end up calling
+// into flex_buf.c, so any difference is overhead added by the wrapper.
+int main() {
+  flex_buf_t raw_chars = buf_alloc(16), raw_words = buf_alloc(16);
+  qml::flex_buf chars(16), words(16);
+  double best, start;
+
+  #define BENCH(name, body)                                                    \
+    best = 1e9;                                                                \
+    for(int run = 0; run < RUNS; run++) {                                      \
+      start = now();                                                           \
+      body;                                                                    \
+      double took = now() - start;                                             \
+      if(took < best)                                                          \
+        best = took;                                                           \
+    }                                                                          \
+    report(name, best);
+
+  BENCH("buf_append", {
+    raw_chars.size = 0;
+    for(int i = 0; i < CHARS; i++)
+      buf_append(&raw_chars, 'a' + i%26);
+  });
+  BENCH("flex_buf << char", {
+    chars.clear();
+    for(int i = 0; i < CHARS; i++)
+      chars << char('a' + i%26);
+  });
+  BENCH("buf_append_n", {
+    raw_words.size = 0;
+    for(int i = 0; i < WORDS; i++)
+      buf_append_n(&raw_words, const_cast<char *>("word "), 5);
+  });
+  BENCH("flex_buf << string_view", {
+    words.clear();
+    for(int i = 0; i < WORDS; i++)
+      words << "word "sv;
+  });
+
+  int same = std::string_view(raw_chars.data, raw_chars.size) == chars.view()
+    && std::string_view(raw_words.data, raw_words.size) == words.view();
+  buf_free(&raw_chars);
+  buf_free(&raw_words);
+  return !same;
+}
@@ -0,0 +1,702 @@
+/*
+flex_buf_io.h
+-------------
+Defines the public API for writing flex_bufs to files without blocking the
+producing thread, and an optional implementation. Every function has a comment
+describing it.
+
+This header builds on flex_buf.h and requires POSIX threads. Compile with
+_GNU_SOURCE (or _DEFAULT_SOURCE) defined and link with -pthread.
+
+To include the implementation with this header file, make sure to define
+QML_FLEXBUF_IO_IMPLEMENTATION beforehand. The flex_buf implementation has to
+be included in one of your translation units as well:
+
+  #define QML_FLEXBUF_IMPLEMENTATION
+  #define QML_FLEXBUF_IO_IMPLEMENTATION
+  #include "flex_buf_io.h"
+
+Basic usage:
+
+  buf_flusher_t *fl = buf_flusher_new(64);  // up to 64 writes in flight
+  flex_buf_t my_buf = buf_alloc(4096);
+  buf_append_lit(&my_buf, "Hello world!\n");
+  // hand the buffer over, my_buf is left empty and can be reused right away
+  buf_flush_async(fl, fd, 0, &my_buf, done_cb, NULL);
+  ...
+  buf_flusher_poll(fl);                     // call done_cb for finished writes
+  buf_flusher_free(fl);                     // wait for everything and clean up
+
+  void done_cb(flex_buf_t buf, ssize_t res, void *ctx) {
+    // res is the amount of bytes written, or -errno if the write failed. The
+    // buffer belongs to the callback again, and can be reused or freed.
+    buf_free(&buf);
+  }
+
+Zero-copy output:
+
+  // page-aligned buffers are handed to pipes with vmsplice
+  flex_buf_t page_buf = buf_alloc_aligned(65536, QML_ALIGN_PAGE);
+  ...
+  buf_splice_out(&page_buf, pipe_fd);
+  // data that is already in a file is sent with sendfile
+  off_t off = 0;
+  buf_splice_file(sock_fd, file_fd, &off, file_size);
+
+Customising behavior:
+
+  // The amount of queued writes that will be submitted to the kernel in a
+  // single io_uring_enter call. Defaults to 16.
+  #define QML_FLEXBUF_IO_BATCH 32
+
+  // If defined, io_uring will not be used even if the kernel supports it and
+  // all writes will go through a worker thread calling pwrite.
+  #define QML_FLEXBUF_IO_NO_IO_URING
+
+On Linux the writes are submitted through io_uring when it is available. In
+every other case, a single worker thread performs them with pwrite. If
+io_uring stops working later on, every write it still had fails with the
+error it returned and the worker thread takes over from then on. Either
+way, the callbacks are only ever called on the thread that calls
+buf_flush_async, buf_flusher_poll or buf_flusher_wait.
+
+*/
+
+#ifndef QML_FLEXBUF_IO_DEFINED
+#define QML_FLEXBUF_IO_DEFINED
+
+#include "flex_buf.h"
+#include <sys/types.h>
+
+#ifndef QML_ALIGN_PAGE
+// Alignment of a single memory page.
+#define QML_ALIGN_PAGE 4096
+#endif
+
+// Called once a write has finished. The callback takes ownership of the buffer
+// back. res is the amount of bytes written or -errno on failure.
+typedef void(buf_flush_cb_t)(flex_buf_t buf, ssize_t res, void *ctx);
+
+typedef struct buf_flusher buf_flusher_t;
+
+// Create a flusher that allows up to depth writes to be in flight at once.
+// Returns NULL if the flusher could not be set up.
+buf_flusher_t *buf_flusher_new(unsigned depth);
+// Queue the buffer's contents to be written to fd at the given offset. The
+// flusher takes ownership of the buffer's data, leaving an empty buffer
+// behind. If the flusher is full, this waits for a write to finish first.
+// Returns 1 on success and 0 if the write could not be queued, in which case
+// the buffer is left untouched.
+int buf_flush_async(buf_flusher_t *fl, int fd, off_t off, flex_buf_t *buf,
+                    buf_flush_cb_t cb, void *ctx);
+// Submit queued writes and call the callbacks of every write that has finished
+// so far, without waiting. Returns the amount of finished writes.
+size_t buf_flusher_poll(buf_flusher_t *fl);
+// Wait for every queued write to finish, calling their callbacks.
+void buf_flusher_wait(buf_flusher_t *fl);
+// Wait for every queued write to finish and free the flusher.
+void buf_flusher_free(buf_flusher_t *fl);
+
+// Write the buffer's entire contents to fd, returning the amount of bytes
+// written or -1 with errno set. If fd is a pipe and the buffer was allocated
+// with buf_alloc_aligned at QML_ALIGN_PAGE or more, the buffer's pages are
+// handed to the pipe with vmsplice instead of being copied. In that case the
+// pipe keeps referencing them, so the buffer must not be changed or freed until
+// the data has been read from the other end. vmsplice is only used when
+// compiling with _GNU_SOURCE. In every other case this falls back to plain
+// write calls.
+ssize_t buf_splice_out(flex_buf_t *buf, int fd);
+// Write amt bytes of in_fd, starting at the offset pointed to by off, to
+// out_fd without copying them through user space, advancing the offset. This
+// is meant for data that has already been flushed to a file. Uses sendfile
+// where possible and falls back to copying through a temporary flex_buf.
+// Returns the amount of bytes written or -1 with errno set.
+ssize_t buf_splice_file(int out_fd, int in_fd, off_t *off, size_t amt);
+
+#endif // QML_FLEXBUF_IO_DEFINED
+
+#ifdef QML_FLEXBUF_IO_IMPLEMENTATION
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#ifndef QML_ALLOC
+#include <stdlib.h>
+#define QML_ALLOC malloc
+#endif
+
+#ifndef QML_FREE
+#include <stdlib.h>
+#define QML_FREE free
+#endif
+
+#ifndef QML_FLEXBUF_IO_BATCH
+#define QML_FLEXBUF_IO_BATCH 16
+#endif
+
+#if defined(__linux__) && !defined(QML_FLEXBUF_IO_NO_IO_URING)
+#define _QML_FLEXBUF_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/sendfile.h>
+// vmsplice is only declared with _GNU_SOURCE
+#ifdef SPLICE_F_MOVE
+#define _QML_FLEXBUF_IO_SPLICE
+#endif
+#endif
+
+typedef struct _buf_flush_job {
+  flex_buf_t      buf;
+  int             fd;
+  off_t           off;
+  size_t          done;
+  ssize_t         res;
+  buf_flush_cb_t *cb;
+  void           *ctx;
+  struct iovec    iov;
+  struct _buf_flush_job *next, *prev;
+} _buf_flush_job_t;
+
+struct buf_flusher {
+  // amount of jobs that have been handed to the flusher, but whose callback
+  // has not been called yet
+  unsigned in_flight, depth;
+
+  // io_uring state, ring_fd is -1 if the worker thread is used instead
+  int       ring_fd;
+  unsigned  queued;
+  void     *sq_ring, *cq_ring;
+  size_t    sq_ring_size, cq_ring_size;
+  unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  void     *sqes, *cqes;
+  size_t    sqes_size;
+  // every job handed to the ring whose completion hasn't been reaped yet
+  _buf_flush_job_t *ring_jobs;
+
+  // worker thread state
+  pthread_t        worker;
+  pthread_mutex_t  lock;
+  pthread_cond_t   wake, idle;
+  _buf_flush_job_t *todo, *todo_tail, *finished, *finished_tail;
+  int              busy, stop;
+
+  // set if io_uring stopped working and the worker thread could not be
+  // started in it's place, every write after that fails right away
+  int dead;
+};
+
+static void _buf_flush_complete(buf_flusher_t *fl, _buf_flush_job_t *job) {
+  fl->in_flight--;
+  if(job->cb != NULL)
+    job->cb(job->buf, job->res, job->ctx);
+  else
+    buf_free(&job->buf);
+  QML_FREE(job);
+}
+
+// Worker thread fallback
+
+static void _buf_flush_pwrite(_buf_flush_job_t *job) {
+  while(job->done < job->buf.size) {
+    ssize_t n = pwrite(job->fd, job->buf.data + job->done,
+                       job->buf.size - job->done, job->off + job->done);
+    if(n < 0) {
+      if(errno == EINTR)
+        continue;
+      job->res = -errno;
+      return;
+    }
+    if(n == 0)
+      break;
+    job->done += n;
+  }
+  job->res = job->done;
+}
+
+static void *_buf_flush_worker(void *arg) {
+  buf_flusher_t *fl = (buf_flusher_t *)arg;
+  pthread_mutex_lock(&fl->lock);
+  for(;;) {
+    while(fl->todo == NULL && !fl->stop)
+      pthread_cond_wait(&fl->wake, &fl->lock);
+    if(fl->todo == NULL)
+      break;
+
+    // take every queued job at once, so that the lock is not held while
+    // writing
+    _buf_flush_job_t *batch = fl->todo, *last = fl->todo_tail;
+    fl->todo = fl->todo_tail = NULL;
+    fl->busy = 1;
+    pthread_mutex_unlock(&fl->lock);
+
+    for(_buf_flush_job_t *job = batch; job != NULL; job = job->next)
+      _buf_flush_pwrite(job);
+
+    pthread_mutex_lock(&fl->lock);
+    if(fl->finished_tail == NULL)
+      fl->finished = batch;
+    else
+      fl->finished_tail->next = batch;
+    fl->finished_tail = last;
+    fl->busy = 0;
+    pthread_cond_broadcast(&fl->idle);
+  }
+  pthread_mutex_unlock(&fl->lock);
+  return NULL;
+}
+
+static size_t _buf_flush_worker_reap(buf_flusher_t *fl) {
+  pthread_mutex_lock(&fl->lock);
+  _buf_flush_job_t *job = fl->finished;
+  fl->finished = fl->finished_tail = NULL;
+  pthread_mutex_unlock(&fl->lock);
+
+  size_t count = 0;
+  while(job != NULL) {
+    _buf_flush_job_t *next = job->next;
+    _buf_flush_complete(fl, job);
+    job = next;
+    count++;
+  }
+  return count;
+}
+
+static void _buf_flush_worker_wait(buf_flusher_t *fl) {
+  pthread_mutex_lock(&fl->lock);
+  while(fl->todo != NULL || fl->busy)
+    pthread_cond_wait(&fl->idle, &fl->lock);
+  pthread_mutex_unlock(&fl->lock);
+}
+
+static int _buf_flush_worker_start(buf_flusher_t *fl) {
+  pthread_mutex_init(&fl->lock, NULL);
+  pthread_cond_init(&fl->wake, NULL);
+  pthread_cond_init(&fl->idle, NULL);
+  if(pthread_create(&fl->worker, NULL, _buf_flush_worker, fl) != 0) {
+    pthread_cond_destroy(&fl->idle);
+    pthread_cond_destroy(&fl->wake);
+    pthread_mutex_destroy(&fl->lock);
+    return 0;
+  }
+  return 1;
+}
+
+// io_uring
+
+#ifdef _QML_FLEXBUF_IO_URING
+
+static int _buf_ring_setup(buf_flusher_t *fl, unsigned depth) {
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  int fd = (int)syscall(__NR_io_uring_setup, depth, &p);
+  if(fd < 0)
+    return 0;
+
+  fl->sq_ring_size = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+  fl->cq_ring_size = p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+  if(p.features & IORING_FEAT_SINGLE_MMAP) {
+    if(fl->cq_ring_size > fl->sq_ring_size)
+      fl->sq_ring_size = fl->cq_ring_size;
+    fl->cq_ring_size = 0;
+  }
+  fl->sq_ring = mmap(NULL, fl->sq_ring_size, PROT_READ|PROT_WRITE,
+                     MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if(fl->sq_ring == MAP_FAILED)
+    goto fail_sq;
+  if(fl->cq_ring_size == 0) {
+    fl->cq_ring = fl->sq_ring;
+  } else {
+    fl->cq_ring = mmap(NULL, fl->cq_ring_size, PROT_READ|PROT_WRITE,
+                       MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if(fl->cq_ring == MAP_FAILED)
+      goto fail_cq;
+  }
+  fl->sqes_size = p.sq_entries*sizeof(struct io_uring_sqe);
+  fl->sqes = mmap(NULL, fl->sqes_size, PROT_READ|PROT_WRITE,
+                  MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQES);
+  if(fl->sqes == MAP_FAILED)
+    goto fail_sqes;
+
+  char *sq = (char *)fl->sq_ring, *cq = (char *)fl->cq_ring;
+  fl->sq_head  = (unsigned *)(sq + p.sq_off.head);
+  fl->sq_tail  = (unsigned *)(sq + p.sq_off.tail);
+  fl->sq_mask  = (unsigned *)(sq + p.sq_off.ring_mask);
+  fl->sq_array = (unsigned *)(sq + p.sq_off.array);
+  fl->cq_head  = (unsigned *)(cq + p.cq_off.head);
+  fl->cq_tail  = (unsigned *)(cq + p.cq_off.tail);
+  fl->cq_mask  = (unsigned *)(cq + p.cq_off.ring_mask);
+  fl->cqes     = cq + p.cq_off.cqes;
+  fl->ring_fd  = fd;
+  // never have more jobs in flight than there are submission entries, which
+  // also keeps the completion ring from overflowing
+  if(fl->depth > p.sq_entries)
+    fl->depth = p.sq_entries;
+  return 1;
+
+fail_sqes:
+  if(fl->cq_ring_size != 0)
+    munmap(fl->cq_ring, fl->cq_ring_size);
+fail_cq:
+  munmap(fl->sq_ring, fl->sq_ring_size);
+fail_sq:
+  close(fd);
+  return 0;
+}
+
+static void _buf_ring_teardown(buf_flusher_t *fl) {
+  munmap(fl->sqes, fl->sqes_size);
+  if(fl->cq_ring_size != 0)
+    munmap(fl->cq_ring, fl->cq_ring_size);
+  munmap(fl->sq_ring, fl->sq_ring_size);
+  close(fl->ring_fd);
+}
+
+static void _buf_ring_push(buf_flusher_t *fl, _buf_flush_job_t *job) {
+  unsigned tail = *fl->sq_tail;
+  unsigned idx = tail & *fl->sq_mask;
+  struct io_uring_sqe *sqe = (struct io_uring_sqe *)fl->sqes + idx;
+  memset(sqe, 0, sizeof(*sqe));
+  job->iov.iov_base = job->buf.data + job->done;
+  job->iov.iov_len = job->buf.size - job->done;
+  sqe->opcode = IORING_OP_WRITEV;
+  sqe->fd = job->fd;
+  sqe->off = job->off + job->done;
+  sqe->addr = (uintptr_t)&job->iov;
+  sqe->len = 1;
+  sqe->user_data = (uintptr_t)job;
+  fl->sq_array[idx] = idx;
+  __atomic_store_n(fl->sq_tail, tail+1, __ATOMIC_RELEASE);
+  fl->queued++;
+}
+
+static void _buf_ring_track(buf_flusher_t *fl, _buf_flush_job_t *job) {
+  job->prev = NULL;
+  job->next = fl->ring_jobs;
+  if(fl->ring_jobs != NULL)
+    fl->ring_jobs->prev = job;
+  fl->ring_jobs = job;
+}
+
+static void _buf_ring_untrack(buf_flusher_t *fl, _buf_flush_job_t *job) {
+  if(job->prev != NULL)
+    job->prev->next = job->next;
+  else
+    fl->ring_jobs = job->next;
+  if(job->next != NULL)
+    job->next->prev = job->prev;
+}
+
+// Submits the queued entries and waits for min_complete of them to finish.
+// Returns 0 on success, or -errno if io_uring_enter failed for any reason
+// other than being interrupted.
+static int _buf_ring_enter(buf_flusher_t *fl, unsigned min_complete) {
+  unsigned flags = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0;
+  for(;;) {
+    int n = (int)syscall(__NR_io_uring_enter, fl->ring_fd, fl->queued,
+                         min_complete, flags, NULL, 0);
+    if(n >= 0) {
+      fl->queued -= n;
+      return 0;
+    }
+    if(errno != EINTR)
+      return -errno;
+  }
+}
+
+// Once io_uring_enter has failed, none of the writes handed to the ring can
+// be counted on to complete. The ring is torn down first, so that no
+// completion is ever read for a job that has been freed, then every
+// outstanding write fails with err and later writes go through the worker
+// thread instead. Returns the amount of callbacks called.
+static size_t _buf_ring_fail(buf_flusher_t *fl, int err) {
+  _buf_ring_teardown(fl);
+  fl->ring_fd = -1;
+  fl->queued = 0;
+  if(!_buf_flush_worker_start(fl))
+    fl->dead = 1;
+
+  _buf_flush_job_t *job = fl->ring_jobs;
+  fl->ring_jobs = NULL;
+  size_t count = 0;
+  while(job != NULL) {
+    _buf_flush_job_t *next = job->next;
+    job->res = err;
+    _buf_flush_complete(fl, job);
+    job = next;
+    count++;
+  }
+  return count;
+}
+
+static size_t _buf_ring_reap(buf_flusher_t *fl) {
+  size_t count = 0;
+  // the callback may queue more writes and reap again itself, or even tear
+  // the ring down, so the head is loaded fresh for every entry instead of
+  // being kept across callbacks
+  while(fl->ring_fd >= 0) {
+    unsigned head = *fl->cq_head;
+    if(head == __atomic_load_n(fl->cq_tail, __ATOMIC_ACQUIRE))
+      break;
+    struct io_uring_cqe *cqe =
+      (struct io_uring_cqe *)fl->cqes + (head & *fl->cq_mask);
+    _buf_flush_job_t *job = (_buf_flush_job_t *)(uintptr_t)cqe->user_data;
+    int res = cqe->res;
+    __atomic_store_n(fl->cq_head, head+1, __ATOMIC_RELEASE);
+
+    if(res > 0 && job->done + res < job->buf.size) {
+      // short write, the submission entry it used is free again already
+      job->done += res;
+      _buf_ring_push(fl, job);
+      continue;
+    }
+    _buf_ring_untrack(fl, job);
+    if(res < 0) {
+      job->res = res;
+    } else {
+      job->done += res;
+      job->res = job->done;
+    }
+    _buf_flush_complete(fl, job);
+    count++;
+  }
+  return count;
+}
+
+#endif // _QML_FLEXBUF_IO_URING
+
+buf_flusher_t *buf_flusher_new(unsigned depth) {
+  if(depth == 0)
+    depth = 1;
+  buf_flusher_t *fl = (buf_flusher_t *)QML_ALLOC(sizeof(buf_flusher_t));
+  if(fl == NULL)
+    return NULL;
+  memset(fl, 0, sizeof(*fl));
+  fl->depth = depth;
+  fl->ring_fd = -1;
+
+  #ifdef _QML_FLEXBUF_IO_URING
+    if(_buf_ring_setup(fl, depth))
+      return fl;
+  #endif
+
+  if(!_buf_flush_worker_start(fl)) {
+    QML_FREE(fl);
+    return NULL;
+  }
+  return fl;
+}
+
+size_t buf_flusher_poll(buf_flusher_t *fl) {
+  #ifdef _QML_FLEXBUF_IO_URING
+    if(fl->ring_fd >= 0) {
+      int err = fl->queued > 0 ? _buf_ring_enter(fl, 0) : 0;
+      if(err != 0)
+        return _buf_ring_fail(fl, err);
+      return _buf_ring_reap(fl);
+    }
+  #endif
+  if(fl->dead)
+    return 0;
+  return _buf_flush_worker_reap(fl);
+}
+
+// Waits until at least one write has finished and calls it's callback.
+static void _buf_flusher_wait_one(buf_flusher_t *fl) {
+  #ifdef _QML_FLEXBUF_IO_URING
+    if(fl->ring_fd >= 0) {
+      while(_buf_ring_reap(fl) == 0) {
+        int err = _buf_ring_enter(fl, 1);
+        if(err != 0) {
+          _buf_ring_fail(fl, err);
+          return;
+        }
+      }
+      return;
+    }
+  #endif
+  pthread_mutex_lock(&fl->lock);
+  while(fl->finished == NULL)
+    pthread_cond_wait(&fl->idle, &fl->lock);
+  pthread_mutex_unlock(&fl->lock);
+  _buf_flush_worker_reap(fl);
+}
+
+int buf_flush_async(buf_flusher_t *fl, int fd, off_t off, flex_buf_t *buf,
+                    buf_flush_cb_t cb, void *ctx) {
+  while(fl->in_flight >= fl->depth)
+    _buf_flusher_wait_one(fl);
+  if(fl->dead)
+    return 0;
+
+  _buf_flush_job_t *job = (_buf_flush_job_t *)QML_ALLOC(sizeof(*job));
+  if(job == NULL)
+    return 0;
+  memset(job, 0, sizeof(*job));
+  job->buf = *buf;
+  job->fd = fd;
+  job->off = off;
+  job->cb = cb;
+  job->ctx = ctx;
+  // the caller keeps an empty buffer with the same alignment
+  *buf = (flex_buf_t){ 0, 0, NULL, buf->align };
+  fl->in_flight++;
+
+  #ifdef _QML_FLEXBUF_IO_URING
+    if(fl->ring_fd >= 0) {
+      _buf_ring_track(fl, job);
+      _buf_ring_push(fl, job);
+      if(fl->queued >= QML_FLEXBUF_IO_BATCH) {
+        int err = _buf_ring_enter(fl, 0);
+        if(err != 0)
+          _buf_ring_fail(fl, err);
+      }
+      return 1;
+    }
+  #endif
+
+  pthread_mutex_lock(&fl->lock);
+  if(fl->todo_tail == NULL)
+    fl->todo = job;
+  else
+    fl->todo_tail->next = job;
+  fl->todo_tail = job;
+  pthread_cond_signal(&fl->wake);
+  pthread_mutex_unlock(&fl->lock);
+  return 1;
+}
+
+void buf_flusher_wait(buf_flusher_t *fl) {
+  #ifdef _QML_FLEXBUF_IO_URING
+    if(fl->ring_fd >= 0) {
+      while(fl->in_flight > 0)
+        _buf_flusher_wait_one(fl);
+      return;
+    }
+  #endif
+  // callbacks may queue more writes, those have to be waited on as well
+  while(fl->in_flight > 0) {
+    _buf_flush_worker_wait(fl);
+    _buf_flush_worker_reap(fl);
+  }
+}
+
+void buf_flusher_free(buf_flusher_t *fl) {
+  buf_flusher_wait(fl);
+
+  #ifdef _QML_FLEXBUF_IO_URING
+    if(fl->ring_fd >= 0) {
+      _buf_ring_teardown(fl);
+      QML_FREE(fl);
+      return;
+    }
+  #endif
+
+  if(fl->dead) {
+    QML_FREE(fl);
+    return;
+  }
+  pthread_mutex_lock(&fl->lock);
+  fl->stop = 1;
+  pthread_cond_signal(&fl->wake);
+  pthread_mutex_unlock(&fl->lock);
+  pthread_join(fl->worker, NULL);
+  pthread_cond_destroy(&fl->idle);
+  pthread_cond_destroy(&fl->wake);
+  pthread_mutex_destroy(&fl->lock);
+  QML_FREE(fl);
+}
+
+// Zero-copy output
+
+static ssize_t _buf_write_all(int fd, const char *data, size_t size) {
+  size_t done = 0;
+  while(done < size) {
+    ssize_t n = write(fd, data + done, size - done);
+    if(n < 0) {
+      if(errno == EINTR)
+        continue;
+      return -1;
+    }
+    done += n;
+  }
+  return done;
+}
+
+ssize_t buf_splice_out(flex_buf_t *buf, int fd) {
+  size_t done = 0;
+
+  #ifdef _QML_FLEXBUF_IO_SPLICE
+    if(buf->align >= QML_ALIGN_PAGE) {
+      while(done < buf->size) {
+        struct iovec iov = { buf->data + done, buf->size - done };
+        ssize_t n = vmsplice(fd, &iov, 1, 0);
+        if(n < 0) {
+          if(errno == EINTR)
+            continue;
+          // not a pipe, write the rest normally
+          if(errno == EBADF || errno == EINVAL)
+            break;
+          return -1;
+        }
+        done += n;
+      }
+    }
+  #endif
+
+  ssize_t n = _buf_write_all(fd, buf->data + done, buf->size - done);
+  if(n < 0)
+    return -1;
+  return done + n;
+}
+
+ssize_t buf_splice_file(int out_fd, int in_fd, off_t *off, size_t amt) {
+  size_t done = 0;
+
+  // unlike vmsplice, sendfile is declared without _GNU_SOURCE
+  #ifdef __linux__
+    while(done < amt) {
+      ssize_t n = sendfile(out_fd, in_fd, off, amt - done);
+      if(n < 0) {
+        if(errno == EINTR)
+          continue;
+        // unsupported combination of descriptors, copy the rest
+        if(errno == EINVAL || errno == ENOSYS)
+          break;
+        return -1;
+      }
+      if(n == 0)
+        return done;
+      done += n;
+    }
+    if(done == amt)
+      return done;
+  #endif
+
+  size_t chunk = amt - done < 65536 ? amt - done : 65536;
+  flex_buf_t tmp = buf_alloc(chunk);
+  while(done < amt) {
+    size_t want = amt - done < chunk ? amt - done : chunk;
+    ssize_t n = pread(in_fd, tmp.data, want, *off);
+    if(n < 0 && errno == EINTR)
+      continue;
+    if(n <= 0 || _buf_write_all(out_fd, tmp.data, n) < 0) {
+      buf_free(&tmp);
+      return n == 0 ? (ssize_t)done : -1;
+    }
+    *off += n;
+    done += n;
+  }
+  buf_free(&tmp);
+  return done;
+}
+
+#endif // QML_FLEXBUF_IO_IMPLEMENTATION
@@ -0,0 +1,81 @@
+#define _GNU_SOURCE
+#define QML_FLEXBUF_IMPLEMENTATION
+#define QML_FLEXBUF_IO_IMPLEMENTATION
+#include "flex_buf_io.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BUF_SIZE (256*1024)
+#define SENDS 4096
+#define RUNS 3
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// drains the pipe until the writing end is closed, counting the bytes
+void *reader_main(void *arg) {
+  int fd = *(int *)arg;
+  static char sink[64*1024];
+  size_t total = 0;
+  ssize_t n;
+  while((n = read(fd, sink, sizeof(sink))) > 0)
+    total += n;
+  return (void *)total;
+}
+
+// Sends the same buffer through a pipe SENDS times, either with write or with
+// buf_splice_out, and returns the time it took for everything to be read.
+static double run(flex_buf_t *buf, int splice, size_t *got) {
+  int fds[2];
+  if(pipe(fds) < 0)
+    return -1;
+  pthread_t reader;
+  pthread_create(&reader, NULL, reader_main, &fds[0]);
+
+  double start = now();
+  for(int i = 0; i < SENDS; i++) {
+    if(splice)
+      buf_splice_out(buf, fds[1]);
+    else
+      _buf_write_all(fds[1], buf->data, buf->size);
+  }
+  close(fds[1]);
+  void *total;
+  pthread_join(reader, &total);
+  double took = now() - start;
+
+  close(fds[0]);
+  *got = (size_t)total;
+  return took;
+}
+
+int main(void) {
+  // the buffer is never changed while spliced pages might still be in the
+  // pipe, which is what makes reusing it safe
+  flex_buf_t buf = buf_alloc_aligned(BUF_SIZE, QML_ALIGN_PAGE);
+  for(int i = 0; i < BUF_SIZE; i++)
+    buf_append(&buf, 'a' + i%26);
+
+  const char *names[2] = { "write", "buf_splice_out" };
+  int wrong = 0;
+  for(int splice = 0; splice < 2; splice++) {
+    double best = 1e9;
+    for(int r = 0; r < RUNS; r++) {
+      size_t got = 0;
+      double took = run(&buf, splice, &got);
+      wrong += got != (size_t)BUF_SIZE*SENDS;
+      if(took < best)
+        best = took;
+    }
+    printf("%-16s %8.2f ms  %8.1f MiB/s\n", names[splice], best*1e3,
+           (double)BUF_SIZE*SENDS / (1024*1024) / best);
+  }
+
+  buf_free(&buf);
+  return wrong != 0;
+}
@@ -0,0 +1,194 @@
+#define _GNU_SOURCE
+#define QML_FLEXBUF_IMPLEMENTATION
+#define QML_FLEXBUF_IO_IMPLEMENTATION
+#include "flex_buf_io.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static size_t written = 0;
+
+void done_cb(flex_buf_t buf, ssize_t res, void *ctx) {
+  (void)ctx;
+  if(res != (ssize_t)buf.size)
+    fprintf(stderr, "Short write: %zd of %zu bytes.\n", res, buf.size);
+  else
+    written += res;
+  buf_free(&buf);
+}
+
+#define CHAIN_RECORDS 200
+
+// every finished record queues two more until there are enough of them, so
+// writes are queued, and reaped, from inside completion callbacks
+static buf_flusher_t *chain_fl;
+static int chain_fd, chain_queued = 0, chain_done = 0;
+
+static void chain_queue(void);
+
+void chain_cb(flex_buf_t buf, ssize_t res, void *ctx) {
+  (void)ctx;
+  if(res == (ssize_t)buf.size)
+    chain_done++;
+  buf_free(&buf);
+  chain_queue();
+  chain_queue();
+}
+
+static void chain_queue(void) {
+  if(chain_queued == CHAIN_RECORDS)
+    return;
+  int i = chain_queued++;
+  flex_buf_t rec = buf_alloc(8);
+  char num[16];
+  snprintf(num, sizeof(num), "%07d\n", i);
+  buf_append_cstr(&rec, num);
+  buf_flush_async(chain_fl, chain_fd, (off_t)i*8, &rec, chain_cb, NULL);
+}
+
+#ifndef QML_FLEXBUF_IO_NO_IO_URING
+static int failed_writes = 0;
+
+void count_failed_cb(flex_buf_t buf, ssize_t res, void *ctx) {
+  (void)ctx;
+  if(res < 0)
+    failed_writes++;
+  buf_free(&buf);
+}
+
+static void queue_byte(buf_flusher_t *fl, int fd, off_t off,
+                       buf_flush_cb_t *cb) {
+  flex_buf_t byte = buf_alloc(1);
+  buf_append(&byte, 'x');
+  buf_flush_async(fl, fd, off, &byte, cb, NULL);
+}
+#endif
+
+int main(int argc, char **argv) {
+  const char *path = argc > 1 ? argv[1] : "flex_buf_io_test.txt";
+  int fd = open(path, O_RDWR|O_CREAT|O_TRUNC, 0644);
+  if(fd < 0) {
+    perror("open");
+    return 1;
+  }
+
+  // write 100 lines, one buffer each, without waiting on any of them
+  buf_flusher_t *fl = buf_flusher_new(8);
+  off_t off = 0;
+  for(int i = 0; i < 100; i++) {
+    flex_buf_t line = buf_alloc(32);
+    char num[16];
+    snprintf(num, sizeof(num), "%02d", i);
+    buf_append_lit(&line, "Line number ");
+    buf_append_cstr(&line, num);
+    buf_append(&line, '\n');
+    size_t size = line.size;
+    buf_flush_async(fl, fd, off, &line, done_cb, NULL);
+    off += size;
+  }
+  buf_flusher_free(fl);
+
+  // read the file back to make sure everything landed in order
+  char *contents = malloc(off);
+  ssize_t got = pread(fd, contents, off, 0);
+  close(fd);
+  unlink(path);
+  int ok = got == off && written == (size_t)off
+    && memcmp(contents + off - 15, "Line number 99\n", 15) == 0;
+  free(contents);
+  printf("Wrote %zu bytes asynchronously: %s\n", written, ok ? "OK" : "FAIL");
+
+  // queue writes from completion callbacks, with a depth low enough that
+  // queueing has to wait on other writes from inside the callbacks too
+  chain_fd = open(path, O_RDWR|O_CREAT|O_TRUNC, 0644);
+  if(chain_fd < 0) {
+    perror("open");
+    return 1;
+  }
+  chain_fl = buf_flusher_new(2);
+  chain_queue();
+  buf_flusher_free(chain_fl);
+  char rec[8];
+  int chain_ok = chain_done == CHAIN_RECORDS
+    && pread(chain_fd, rec, 8, (CHAIN_RECORDS-1)*8) == 8
+    && memcmp(rec, "0000199\n", 8) == 0;
+  close(chain_fd);
+  unlink(path);
+  printf("Wrote %d records from callbacks: %s\n", chain_done,
+         chain_ok ? "OK" : "FAIL");
+
+  // break the ring by putting a plain file where it's descriptor was, so that
+  // io_uring_enter fails with something other than EINTR. The writes still
+  // on the ring have to fail instead of being waited on forever, and later
+  // writes have to go through the worker thread.
+  int broken_ok = 1;
+  #ifndef QML_FLEXBUF_IO_NO_IO_URING
+    int broken_fd = open(path, O_RDWR|O_CREAT|O_TRUNC, 0644);
+    if(broken_fd < 0) {
+      perror("open");
+      return 1;
+    }
+    buf_flusher_t *broken = buf_flusher_new(8);
+    if(broken->ring_fd >= 0) {
+      written = 0;
+      for(int i = 0; i < 4; i++)
+        queue_byte(broken, broken_fd, i, count_failed_cb);
+      dup2(broken_fd, broken->ring_fd);
+      buf_flusher_wait(broken);
+      broken_ok = failed_writes == 4 && broken->ring_fd < 0;
+      for(int i = 0; i < 4; i++)
+        queue_byte(broken, broken_fd, i, done_cb);
+      buf_flusher_wait(broken);
+      broken_ok = broken_ok && failed_writes == 4 && written == 4;
+      printf("Failed %d writes once io_uring broke: %s\n", failed_writes,
+             broken_ok ? "OK" : "FAIL");
+    }
+    buf_flusher_free(broken);
+    close(broken_fd);
+    unlink(path);
+  #endif
+
+  // hand a page-aligned buffer to a pipe, small enough to fit in it whole
+  int pipe_fds[2];
+  if(pipe(pipe_fds) < 0) {
+    perror("pipe");
+    return 1;
+  }
+  flex_buf_t page_buf = buf_alloc_aligned(QML_ALIGN_PAGE*2, QML_ALIGN_PAGE);
+  for(int i = 0; i < QML_ALIGN_PAGE*2; i++)
+    buf_append(&page_buf, 'a' + i%26);
+  ssize_t spliced = buf_splice_out(&page_buf, pipe_fds[1]);
+  char back[QML_ALIGN_PAGE*2];
+  ssize_t read_back = read(pipe_fds[0], back, sizeof(back));
+  int spliced_ok = spliced == (ssize_t)page_buf.size && read_back == spliced
+    && memcmp(back, page_buf.data, spliced) == 0;
+  // only safe to free now that the other end has read everything
+  buf_free(&page_buf);
+  close(pipe_fds[0]);
+  close(pipe_fds[1]);
+  printf("Spliced %zd bytes into a pipe: %s\n", spliced,
+         spliced_ok ? "OK" : "FAIL");
+
+  // send part of a file into a pipe, starting at an offset
+  int file_fd = open(path, O_RDWR|O_CREAT|O_TRUNC, 0644);
+  if(file_fd < 0 || pipe(pipe_fds) < 0) {
+    perror("open");
+    return 1;
+  }
+  const char *text = "skip this, send this";
+  ssize_t wrote = write(file_fd, text, strlen(text));
+  off_t file_off = 11;
+  ssize_t sent = buf_splice_file(pipe_fds[1], file_fd, &file_off, 9);
+  char sent_back[9];
+  int sent_ok = wrote == (ssize_t)strlen(text) && sent == 9 && file_off == 20
+    && read(pipe_fds[0], sent_back, 9) == 9
+    && memcmp(sent_back, "send this", 9) == 0;
+  close(pipe_fds[0]);
+  close(pipe_fds[1]);
+  close(file_fd);
+  unlink(path);
+  printf("Sent %zd bytes of a file into a pipe: %s\n", sent,
+         sent_ok ? "OK" : "FAIL");
+  return !ok || !chain_ok || !broken_ok || !spliced_ok || !sent_ok;
+}
@@ -4,6 +4,84 @@
 #include <stddef.h>
 #include <stdio.h>
 
+// Reads a varint out of the given bytes, returning 1 only if it succeeds with
+// the expected value and consumes all of them, or if it fails without moving
+// the reader when want_ok is 0.
+int check_varint(const char *bytes, size_t amt, int want_ok, uint64_t want) {
+  buf_reader_t rd = { 0, amt, bytes };
+  uint64_t val = 0;
+  int ok = buf_get_varint(&rd, &val);
+  if(!want_ok)
+    return !ok && rd.pos == 0;
+  return ok && val == want && rd.pos == amt;
+}
+
+// Writes a value of every kind with the buf_put_* functions and reads them back
+// with a reader, returning 1 if everything matches.
+int check_codec(void) {
+  const uint64_t varints[] = { 0, 1, 127, 128, 300, 16383, 16384,
+                               (uint64_t)1 << 35, UINT64_MAX };
+  const int64_t svarints[] = { 0, -1, 1, -64, 64, INT64_MIN, INT64_MAX };
+  flex_buf_t msg = buf_alloc(4);
+  buf_put_u16le(&msg, 0xBEEF);
+  buf_put_u32le(&msg, 0xC0FFEE);
+  buf_put_u64le(&msg, 0x0123456789ABCDEFULL);
+  for(size_t i = 0; i < sizeof(varints)/sizeof(varints[0]); i++)
+    buf_put_varint(&msg, varints[i]);
+  for(size_t i = 0; i < sizeof(svarints)/sizeof(svarints[0]); i++)
+    buf_put_svarint(&msg, svarints[i]);
+  buf_put_blob(&msg, "hello", 5);
+  buf_put_blob(&msg, "", 0);
+
+  // fixed-width integers are little-endian whatever the machine is
+  int ok = memcmp(msg.data, "\xef\xbe\xee\xff\xc0\x00", 6) == 0;
+  buf_reader_t rd = buf_reader(&msg);
+  uint16_t u16;
+  uint32_t u32;
+  uint64_t u64;
+  ok = ok && buf_get_u16le(&rd, &u16) && u16 == 0xBEEF
+    && buf_get_u32le(&rd, &u32) && u32 == 0xC0FFEE
+    && buf_get_u64le(&rd, &u64) && u64 == 0x0123456789ABCDEFULL;
+  for(size_t i = 0; i < sizeof(varints)/sizeof(varints[0]); i++)
+    ok = ok && buf_get_varint(&rd, &u64) && u64 == varints[i];
+  for(size_t i = 0; i < sizeof(svarints)/sizeof(svarints[0]); i++) {
+    int64_t s64;
+    ok = ok && buf_get_svarint(&rd, &s64) && s64 == svarints[i];
+  }
+  const char *blob;
+  size_t amt;
+  ok = ok && buf_get_blob(&rd, &blob, &amt) && amt == 5
+    && memcmp(blob, "hello", 5) == 0
+    && buf_get_blob(&rd, &blob, &amt) && amt == 0;
+  // everything was read, so anything more is truncated
+  ok = ok && rd.pos == msg.size && !buf_get_u16le(&rd, &u16)
+    && !buf_get_varint(&rd, &u64) && rd.pos == msg.size;
+
+  // a blob longer than the data left is refused as a whole
+  msg.size = 0;
+  buf_put_blob(&msg, "hello", 5);
+  msg.size--;
+  rd = buf_reader(&msg);
+  ok = ok && !buf_get_blob(&rd, &blob, &amt) && rd.pos == 0
+    && !buf_get_u64le(&rd, &u64) && rd.pos == 0;
+  buf_free(&msg);
+  return ok;
+}
+
+// Aligned buffers have to stay aligned and keep their contents as they grow
+// and shrink, and be freed even when they were allocated without capacity.
+int check_aligned(void) {
+  flex_buf_t buf = buf_alloc_aligned(0, QML_ALIGN_CACHE_LINE);
+  int ok = (uintptr_t)buf.data % QML_ALIGN_CACHE_LINE == 0;
+  for(int i = 0; i < 1000; i++)
+    buf_append(&buf, 'a' + i%26);
+  buf_shrink(&buf);
+  ok = ok && (uintptr_t)buf.data % QML_ALIGN_CACHE_LINE == 0
+    && buf.size == 1000 && buf.data[999] == 'a' + 999%26;
+  buf_free(&buf);
+  return ok && buf.data == NULL;
+}
+
 int main(int argc, char** argv) {
   flex_buf_t buf = buf_alloc(argc*10);
   buf_append_lit(&buf, "Command line:\n");
@@ -15,5 +93,19 @@ int main(int argc, char** argv) {
   char final[buf.size+1];
   buf_finalize(&buf, final);
   printf("%s\n", final);
-  return 0;
+
+  // malformed varints are refused and leave the reader where it was
+  int varints_ok =
+    check_varint("\xff\xff\xff\xff\xff\xff\xff\xff\xff\x01", 10, 1, UINT64_MAX)
+    && check_varint("\xff\xff\xff\xff\xff\xff\xff\xff\xff\x02", 10, 0, 0)
+    && check_varint("\x80\x80\x80\x80\x80\x80\x80\x80\x80\x7f", 10, 0, 0)
+    && check_varint("\x80\x00", 2, 0, 0)
+    && check_varint("\x80", 1, 0, 0)
+    && check_varint("\x00", 1, 1, 0);
+  printf("Malformed varints refused: %s\n", varints_ok ? "OK" : "FAIL");
+  int codec_ok = check_codec();
+  printf("Values read back as written: %s\n", codec_ok ? "OK" : "FAIL");
+  int aligned_ok = check_aligned();
+  printf("Aligned buffers stay aligned: %s\n", aligned_ok ? "OK" : "FAIL");
+  return !varints_ok || !codec_ok || !aligned_ok;
 }
@@ -0,0 +1,105 @@
+// The implementation comes from flex_buf.c, link with it.
+#include "flex_buf.hpp"
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <utility>
+
+using namespace std::literals;
+
+// Checks the ownership rules: clones are independent copies, released buffers
+// belong to the caller, and move assignment frees what was there before. Any
+// leak or double free along the way is left to the sanitizers to catch.
+static bool check_ownership() {
+  bool ok = true;
+
+  qml::flex_buf original(4);
+  original << "some text";
+  qml::flex_buf copy = original.clone();
+  ok = ok && copy.view() == "some text" && copy.data() != original.data();
+  copy << '!';
+  ok = ok && original.view() == "some text" && copy.view() == "some text!";
+
+  // clones keep the alignment, and moving from an aligned buffer leaves it
+  // aligned for the next allocation
+  qml::flex_buf aligned(16, QML_ALIGN_CACHE_LINE);
+  aligned << "aligned";
+  qml::flex_buf aligned_copy = aligned.clone();
+  ok = ok && aligned_copy.get()->align == QML_ALIGN_CACHE_LINE
+    && (uintptr_t)aligned_copy.data() % QML_ALIGN_CACHE_LINE == 0
+    && aligned_copy.view() == "aligned";
+  qml::flex_buf aligned_moved = std::move(aligned);
+  ok = ok && aligned.get()->align == QML_ALIGN_CACHE_LINE
+    && aligned_moved.view() == "aligned";
+
+  // release hands the memory to the caller, who has to free it
+  flex_buf_t raw = copy.release();
+  ok = ok && copy.empty() && copy.data() == nullptr && copy.capacity() == 0
+    && std::string_view(raw.data, raw.size) == "some text!";
+  buf_free(&raw);
+
+  // a raw buffer can be adopted again
+  qml::flex_buf adopted(buf_alloc(8));
+  adopted << "adopted";
+
+  // move assignment frees the buffer being replaced
+  qml::flex_buf target(8);
+  target << "replaced";
+  target = std::move(adopted);
+  ok = ok && target.view() == "adopted" && adopted.empty()
+    && adopted.data() == nullptr;
+  // moving a buffer onto itself changes nothing
+  qml::flex_buf &self = target;
+  target = std::move(self);
+  ok = ok && target.view() == "adopted";
+  return ok;
+}
+
+// Checks that reserved room is written without the buffer moving, both through
+// the spare capacity and through plain appends.
+static bool check_reserve() {
+  bool ok = true;
+  qml::flex_buf buf(2);
+  buf << "ab";
+  buf.reserve(64);
+  const char *data = buf.data();
+  ok = ok && buf.capacity() - buf.size() >= 64 && buf.view() == "ab";
+
+#if __cplusplus >= 202002L
+  std::span<char> spare = buf.spare();
+  ok = ok && spare.data() == buf.data() + 2 && spare.size() >= 64;
+  std::memcpy(spare.data(), "0123456789", 10);
+#else
+  std::memcpy(buf.data() + buf.size(), "0123456789", 10);
+#endif
+  buf.commit(10);
+  ok = ok && buf.view() == "ab0123456789";
+
+  for(int i = 0; i < 50; i++)
+    buf << 'x';
+  ok = ok && buf.data() == data && buf.size() == 62;
+
+  buf.clear();
+  ok = ok && buf.empty() && buf.data() == data;
+  buf.shrink();
+  ok = ok && buf.capacity() == 1;
+  buf << "grows back"sv;
+  return ok && buf.view() == "grows back";
+}
+
+int main(int argc, char** argv) {
+  qml::flex_buf buf(argc*10);
+  buf << "Command line:\n";
+  for(int i = 0; i < argc-1; i++)
+    buf << argv[i] << ' ';
+  buf << argv[argc-1];
+
+  // moving hands the data over without copying it
+  qml::flex_buf moved = std::move(buf);
+  std::cout << std::string_view(moved) << '\n';
+
+  bool owned = check_ownership(), reserved = check_reserve();
+  std::cout << "Ownership: " << (owned ? "OK" : "FAIL") << '\n';
+  std::cout << "Reserving: " << (reserved ? "OK" : "FAIL") << '\n';
+  return !buf.empty() || buf.data() != nullptr || !owned || !reserved;
+}
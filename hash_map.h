@@ -0,0 +1,495 @@
+/*
+hash_map.h
+----------
+Defines the public API for a hash map of fixed-size keys and values, and a
+basic implementation.
+
+To include the implementation with this header file, define
+QML_HASH_MAP_IMPLEMENTATION beforehand:
+
+  #define QML_HASH_MAP_IMPLEMENTATION
+  #include "hash_map.h"
+
+Basic usage:
+
+  // map integers to doubles, the keys and values are copied into the map
+  hash_map_t my_map = hash_map_alloc(sizeof(int), sizeof(double), 100);
+  for(int i = 0; i < 100; i++) {
+    double half = i * 0.5;
+    hash_map_put(&my_map, &i, &half);
+  }
+  int key = 42;
+  double *found = hash_map_get(&my_map, &key);  // NULL if it's missing
+  hash_map_remove(&my_map, &key);
+  hash_map_free(&my_map);
+
+  // keys are hashed and compared byte by byte, unless told otherwise
+  hash_map_t by_name = hash_map_alloc_with(sizeof(char *), sizeof(int), 0,
+                                           str_hash_cb, str_eq_cb);
+
+Customising behavior:
+
+  // You can pick and choose which functions will be used for memory management.
+  // These are expected to have the exact signatures of the stdlib functions
+  // malloc and free respectively.
+  #define QML_ALLOC my_alloc
+  #define QML_FREE my_free
+
+  // If defined, control bytes are always matched 8 at a time with plain
+  // integer arithmetic, instead of 16 at a time with SSE2 where it's
+  // available.
+  #define QML_HASH_MAP_NO_SIMD
+
+How it works:
+
+  The map is an open addressing table in the style of Abseil's SwissTable.
+  Every slot has a control byte which is either empty, deleted or holds 7 bits
+  of the key's hash. A lookup compares a whole group of control bytes against
+  those 7 bits at once, and only compares keys for the slots that match, so
+  most lookups touch a single cache line of control bytes and a single key.
+  The keys and values are stored next to each other in one flat array.
+
+  Growing the map rehashes every key at once. To insert many keys without
+  growing several times, call hash_map_reserve first.
+
+*/
+
+#ifndef QML_HASH_MAP_DEFINED
+#define QML_HASH_MAP_DEFINED
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Hashes a key stored in the map.
+typedef uint64_t(hash_map_hash_cb_t)(const void *key, size_t key_size);
+// Returns non-zero if the two keys are equal.
+typedef int(hash_map_eq_cb_t)(const void *a, const void *b, size_t key_size);
+// Called with every (key, value) pair of the map. If the callback returns 0,
+// the iteration will be stopped.
+typedef int(hash_map_iter_cb_t)(const void *key, void *value);
+
+typedef struct hash_map {
+  size_t   len, cap;
+  // How many more keys can be inserted before the map has to grow.
+  size_t   growth_left;
+  uint8_t *ctrl;
+    char  *slots;
+  size_t   key_size, val_size, val_offset, slot_size;
+  hash_map_hash_cb_t *hash;
+  hash_map_eq_cb_t   *eq;
+} hash_map_t;
+
+// Create a map of key_size byte keys and val_size byte values, with room for
+// at least cap entries. Keys are hashed and compared byte by byte.
+hash_map_t hash_map_alloc(size_t key_size, size_t val_size, size_t cap);
+// Create a map like hash_map_alloc, with the given functions to hash and
+// compare keys.
+hash_map_t hash_map_alloc_with(size_t key_size, size_t val_size, size_t cap,
+                               hash_map_hash_cb_t hash, hash_map_eq_cb_t eq);
+// Get a pointer to the value stored for the given key, or NULL if there is
+// none. The pointer is invalidated when the map grows.
+void *hash_map_get(hash_map_t *map, const void *key);
+// Copy the key and value into the map, replacing the value if the key is in the
+// map already. Returns a pointer to the stored value, or NULL if the map had
+// to grow and could not.
+void *hash_map_put(hash_map_t *map, const void *key, const void *value);
+// Remove the given key and it's value from the map. Returns 0 if the key was
+// not in the map.
+int hash_map_remove(hash_map_t *map, const void *key);
+// Grow the map, if necessary, so that at least amt more keys can be inserted
+// without it growing again. Returns 0 if the memory could not be allocated.
+int hash_map_reserve(hash_map_t *map, size_t amt);
+// Iterates through every (key, value) pair of the map, in no particular order.
+// If the callback returns 0, the iteration will be stopped.
+void hash_map_iter(hash_map_t *map, hash_map_iter_cb_t cb);
+// Remove every key from the map without releasing any memory.
+void hash_map_clear(hash_map_t *map);
+// Frees the map's allocated memory and sets it as empty. The key and value
+// sizes and the callbacks are kept.
+void hash_map_free(hash_map_t *map);
+
+// Hashes the key byte by byte. Used by maps created with hash_map_alloc.
+uint64_t hash_map_hash_bytes(const void *key, size_t key_size);
+// Compares the keys byte by byte. Used by maps created with hash_map_alloc.
+int hash_map_eq_bytes(const void *a, const void *b, size_t key_size);
+
+#endif // QML_HASH_MAP_DEFINED
+
+#ifdef QML_HASH_MAP_IMPLEMENTATION
+
+#include <string.h>
+
+#ifndef QML_ALLOC
+#include <stdlib.h>
+#define QML_ALLOC malloc
+#endif
+
+#ifndef QML_FREE
+#include <stdlib.h>
+#define QML_FREE free
+#endif
+
+#if defined(__SSE2__) && !defined(QML_HASH_MAP_NO_SIMD)
+#include <emmintrin.h>
+#define _HASH_MAP_SSE2
+#endif
+
+// Control bytes of slots without a key. Full slots hold the lowest 7 bits of
+// their key's hash, so the highest bit tells them apart.
+#define _HASH_MAP_EMPTY   ((uint8_t)0x80)
+#define _HASH_MAP_DELETED ((uint8_t)0xFE)
+
+// Groups of control bytes
+//
+// A group is the control bytes of a few consecutive slots, starting anywhere in
+// the table. The first group's worth of control bytes is repeated after the
+// last one, so a group can always be loaded at once. Matching a group gives a
+// mask with a bit set for every matching slot.
+
+#ifdef _HASH_MAP_SSE2
+
+#define _HASH_MAP_GROUP 16
+typedef uint32_t _hash_map_mask_t;
+
+static inline _hash_map_mask_t _hash_map_match(const uint8_t *ctrl,
+                                               uint8_t h2) {
+  __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+  __m128i cmp = _mm_cmpeq_epi8(group, _mm_set1_epi8((char)h2));
+  return (_hash_map_mask_t)_mm_movemask_epi8(cmp);
+}
+
+static inline _hash_map_mask_t _hash_map_match_empty(const uint8_t *ctrl) {
+  return _hash_map_match(ctrl, _HASH_MAP_EMPTY);
+}
+
+// Matches the slots that are either empty or deleted.
+static inline _hash_map_mask_t _hash_map_match_free(const uint8_t *ctrl) {
+  __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+  return (_hash_map_mask_t)_mm_movemask_epi8(group);
+}
+
+// Index of the slot of the lowest bit set in a non-zero mask.
+static inline unsigned _hash_map_first(_hash_map_mask_t mask) {
+  return (unsigned)__builtin_ctz(mask);
+}
+
+#else
+
+// Without SIMD, the 8 control bytes of a group are matched in a single 64 bit
+// integer, with the result in the highest bit of every byte.
+#define _HASH_MAP_GROUP 8
+typedef uint64_t _hash_map_mask_t;
+
+#define _HASH_MAP_LSBS 0x0101010101010101ULL
+#define _HASH_MAP_MSBS 0x8080808080808080ULL
+
+static inline uint64_t _hash_map_load(const uint8_t *ctrl) {
+  uint64_t group;
+  memcpy(&group, ctrl, sizeof(group));
+  #if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    group = __builtin_bswap64(group);
+  #endif
+  return group;
+}
+
+// May also match a byte right after a matching one, which is harmless since
+// every match is checked by comparing the keys.
+static inline _hash_map_mask_t _hash_map_match(const uint8_t *ctrl,
+                                               uint8_t h2) {
+  uint64_t x = _hash_map_load(ctrl) ^ (_HASH_MAP_LSBS * h2);
+  return (x - _HASH_MAP_LSBS) & ~x & _HASH_MAP_MSBS;
+}
+
+static inline _hash_map_mask_t _hash_map_match_empty(const uint8_t *ctrl) {
+  // empty is the only control byte with the highest bit set and the second
+  // lowest one clear
+  uint64_t group = _hash_map_load(ctrl);
+  return group & ~(group << 6) & _HASH_MAP_MSBS;
+}
+
+// Matches the slots that are either empty or deleted.
+static inline _hash_map_mask_t _hash_map_match_free(const uint8_t *ctrl) {
+  return _hash_map_load(ctrl) & _HASH_MAP_MSBS;
+}
+
+// Index of the slot of the lowest bit set in a non-zero mask.
+static inline unsigned _hash_map_first(_hash_map_mask_t mask) {
+  return (unsigned)__builtin_ctzll(mask) >> 3;
+}
+
+#endif
+
+// Implementation
+
+uint64_t hash_map_hash_bytes(const void *key, size_t key_size) {
+  const unsigned char *bytes = (const unsigned char *)key;
+  uint64_t h = 0x9E3779B97F4A7C15ULL ^ key_size;
+  while(key_size >= 8) {
+    uint64_t chunk;
+    memcpy(&chunk, bytes, 8);
+    h = (h ^ chunk) * 0xBF58476D1CE4E5B9ULL;
+    h ^= h >> 31;
+    bytes += 8;
+    key_size -= 8;
+  }
+  if(key_size > 0) {
+    // byte by byte, a memcpy of a size only known at runtime would be a call
+    uint64_t chunk = 0;
+    for(size_t i = 0; i < key_size; i++)
+      chunk |= (uint64_t)bytes[i] << (8*i);
+    h = (h ^ chunk) * 0xBF58476D1CE4E5B9ULL;
+  }
+  // spread every bit over the whole hash, both the table index and the 7 bits
+  // in the control bytes depend on it
+  h ^= h >> 33;
+  h *= 0xFF51AFD7ED558CCDULL;
+  h ^= h >> 33;
+  h *= 0xC4CEB9FE1A85EC53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+int hash_map_eq_bytes(const void *a, const void *b, size_t key_size) {
+  return memcmp(a, b, key_size) == 0;
+}
+
+// Largest power of two, up to 8, that size is a multiple of. Used as the
+// alignment of keys and values.
+static size_t _hash_map_align_of(size_t size) {
+  size_t align = size & -size;
+  return align == 0 || align > 8 ? 8 : align;
+}
+
+hash_map_t hash_map_alloc_with(size_t key_size, size_t val_size, size_t cap,
+                               hash_map_hash_cb_t hash, hash_map_eq_cb_t eq) {
+  hash_map_t map;
+  memset(&map, 0, sizeof(map));
+  map.key_size = key_size;
+  map.val_size = val_size;
+  map.hash = hash;
+  map.eq = eq;
+
+  size_t key_align = _hash_map_align_of(key_size);
+  size_t val_align = _hash_map_align_of(val_size);
+  size_t align = key_align > val_align ? key_align : val_align;
+  map.val_offset = (key_size + val_align - 1) & ~(val_align - 1);
+  map.slot_size = (map.val_offset + val_size + align - 1) & ~(align - 1);
+
+  if(cap > 0)
+    hash_map_reserve(&map, cap);
+  return map;
+}
+
+hash_map_t hash_map_alloc(size_t key_size, size_t val_size, size_t cap) {
+  return hash_map_alloc_with(key_size, val_size, cap, hash_map_hash_bytes,
+                             hash_map_eq_bytes);
+}
+
+static inline char *_hash_map_slot(hash_map_t *map, size_t idx) {
+  return map->slots + map->slot_size*idx;
+}
+
+// Hashes a key with the map's function. The default one is called directly,
+// which lets it be inlined instead of going through a pointer for every key.
+static inline uint64_t _hash_map_hash(hash_map_t *map, const void *key) {
+  if(map->hash == hash_map_hash_bytes)
+    return hash_map_hash_bytes(key, map->key_size);
+  return map->hash(key, map->key_size);
+}
+
+// Compares two keys with the map's function, calling the default one directly
+// like _hash_map_hash. Keys of 4 or 8 bytes are compared as single integers
+// rather than with a call to memcmp.
+static inline int _hash_map_eq(hash_map_t *map, const void *a, const void *b) {
+  if(map->eq != hash_map_eq_bytes)
+    return map->eq(a, b, map->key_size);
+  if(map->key_size == sizeof(uint32_t)) {
+    uint32_t x, y;
+    memcpy(&x, a, sizeof(x));
+    memcpy(&y, b, sizeof(y));
+    return x == y;
+  }
+  if(map->key_size == sizeof(uint64_t)) {
+    uint64_t x, y;
+    memcpy(&x, a, sizeof(x));
+    memcpy(&y, b, sizeof(y));
+    return x == y;
+  }
+  return memcmp(a, b, map->key_size) == 0;
+}
+
+// Copies a key or value into a slot, without calling memcpy for the common
+// sizes.
+static inline void _hash_map_copy(void *dst, const void *src, size_t size) {
+  if(size == sizeof(uint32_t))
+    memcpy(dst, src, sizeof(uint32_t));
+  else if(size == sizeof(uint64_t))
+    memcpy(dst, src, sizeof(uint64_t));
+  else
+    memcpy(dst, src, size);
+}
+
+// Sets a slot's control byte, and it's copy after the table if it has one.
+static inline void _hash_map_set_ctrl(hash_map_t *map, size_t idx,
+                                      uint8_t ctrl) {
+  map->ctrl[idx] = ctrl;
+  if(idx < _HASH_MAP_GROUP)
+    map->ctrl[map->cap + idx] = ctrl;
+}
+
+// Finds the first free slot along the hash's probe sequence.
+static size_t _hash_map_find_free(hash_map_t *map, uint64_t hash) {
+  size_t mask = map->cap - 1;
+  size_t pos = (size_t)(hash >> 7) & mask;
+  // probing by triangular numbers of groups visits every group once
+  for(size_t step = _HASH_MAP_GROUP;; step += _HASH_MAP_GROUP) {
+    _hash_map_mask_t free = _hash_map_match_free(map->ctrl + pos);
+    if(free != 0)
+      return (pos + _hash_map_first(free)) & mask;
+    pos = (pos + step) & mask;
+  }
+}
+
+// Finds the slot holding the key, or returns the map's capacity if there is
+// none.
+static size_t _hash_map_find(hash_map_t *map, const void *key,
+                             uint64_t hash) {
+  if(map->cap == 0)
+    return 0;
+  size_t mask = map->cap - 1;
+  size_t pos = (size_t)(hash >> 7) & mask;
+  uint8_t h2 = (uint8_t)(hash & 0x7F);
+  for(size_t step = _HASH_MAP_GROUP;; step += _HASH_MAP_GROUP) {
+    const uint8_t *group = map->ctrl + pos;
+    for(_hash_map_mask_t m = _hash_map_match(group, h2); m != 0; m &= m - 1) {
+      size_t idx = (pos + _hash_map_first(m)) & mask;
+      if(_hash_map_eq(map, _hash_map_slot(map, idx), key))
+        return idx;
+    }
+    // a key is never placed past an empty slot of it's probe sequence
+    if(_hash_map_match_empty(group) != 0)
+      return map->cap;
+    pos = (pos + step) & mask;
+  }
+}
+
+// Moves every key into a new table of the given capacity, which is a power of
+// two no smaller than a group. Deleted slots are dropped along the way.
+static int _hash_map_rehash(hash_map_t *map, size_t cap) {
+  // the slots follow the control bytes, aligned for any key or value
+  size_t ctrl_size = (cap + _HASH_MAP_GROUP + 15) & ~(size_t)15;
+  char *mem = (char *)QML_ALLOC(ctrl_size + map->slot_size*cap);
+  if(mem == NULL)
+    return 0;
+
+  hash_map_t old = *map;
+  map->cap = cap;
+  map->ctrl = (uint8_t *)mem;
+  map->slots = mem + ctrl_size;
+  map->growth_left = cap - cap/8 - map->len;
+  memset(map->ctrl, _HASH_MAP_EMPTY, cap + _HASH_MAP_GROUP);
+
+  for(size_t i = 0; i < old.cap; i++) {
+    if(old.ctrl[i] & 0x80)
+      continue;
+    char *slot = _hash_map_slot(&old, i);
+    uint64_t hash = _hash_map_hash(map, slot);
+    size_t idx = _hash_map_find_free(map, hash);
+    _hash_map_set_ctrl(map, idx, (uint8_t)(hash & 0x7F));
+    _hash_map_copy(_hash_map_slot(map, idx), slot, map->slot_size);
+  }
+
+  // the control bytes and slots share the allocation
+  if(old.ctrl != NULL)
+    QML_FREE(old.ctrl);
+  return 1;
+}
+
+int hash_map_reserve(hash_map_t *map, size_t amt) {
+  if(amt <= map->growth_left)
+    return 1;
+  // keep the table at most 7/8 full
+  size_t want = map->len + amt;
+  size_t cap = _HASH_MAP_GROUP;
+  while(cap - cap/8 < want)
+    cap <<= 1;
+  return _hash_map_rehash(map, cap);
+}
+
+void *hash_map_get(hash_map_t *map, const void *key) {
+  uint64_t hash = _hash_map_hash(map, key);
+  size_t idx = _hash_map_find(map, key, hash);
+  if(idx == map->cap)
+    return NULL;
+  return _hash_map_slot(map, idx) + map->val_offset;
+}
+
+void *hash_map_put(hash_map_t *map, const void *key, const void *value) {
+  uint64_t hash = _hash_map_hash(map, key);
+  size_t idx = _hash_map_find(map, key, hash);
+  if(idx == map->cap) {
+    if(map->cap == 0 && !hash_map_reserve(map, 1))
+      return NULL;
+    idx = _hash_map_find_free(map, hash);
+    // reusing a deleted slot doesn't make probe sequences any longer
+    if(map->ctrl[idx] == _HASH_MAP_EMPTY && map->growth_left == 0) {
+      // if most of the table is deleted slots, rehashing at the same size
+      // is enough to clear them out
+      size_t cap = map->len < (map->cap - map->cap/8)/2 ? map->cap
+                                                        : map->cap*2;
+      if(!_hash_map_rehash(map, cap))
+        return NULL;
+      idx = _hash_map_find_free(map, hash);
+    }
+    if(map->ctrl[idx] == _HASH_MAP_EMPTY)
+      map->growth_left--;
+    _hash_map_set_ctrl(map, idx, (uint8_t)(hash & 0x7F));
+    _hash_map_copy(_hash_map_slot(map, idx), key, map->key_size);
+    map->len++;
+  }
+
+  char *val = _hash_map_slot(map, idx) + map->val_offset;
+  _hash_map_copy(val, value, map->val_size);
+  return val;
+}
+
+int hash_map_remove(hash_map_t *map, const void *key) {
+  uint64_t hash = _hash_map_hash(map, key);
+  size_t idx = _hash_map_find(map, key, hash);
+  if(idx == map->cap)
+    return 0;
+  // other keys may have probed past this slot, so it can't become empty
+  _hash_map_set_ctrl(map, idx, _HASH_MAP_DELETED);
+  map->len--;
+  return 1;
+}
+
+void hash_map_iter(hash_map_t *map, hash_map_iter_cb_t cb) {
+  for(size_t i = 0; i < map->cap; i++) {
+    if(map->ctrl[i] & 0x80)
+      continue;
+    char *slot = _hash_map_slot(map, i);
+    if(!cb(slot, slot + map->val_offset))
+      break;
+  }
+}
+
+void hash_map_clear(hash_map_t *map) {
+  if(map->cap == 0)
+    return;
+  memset(map->ctrl, _HASH_MAP_EMPTY, map->cap + _HASH_MAP_GROUP);
+  map->len = 0;
+  map->growth_left = map->cap - map->cap/8;
+}
+
+void hash_map_free(hash_map_t *map) {
+  if(map->ctrl != NULL)
+    QML_FREE(map->ctrl);
+  map->ctrl = NULL;
+  map->slots = NULL;
+  map->len = 0;
+  map->cap = 0;
+  map->growth_left = 0;
+}
+
+#endif // QML_HASH_MAP_IMPLEMENTATION
@@ -0,0 +1,104 @@
+#define _GNU_SOURCE
+#define QML_HASH_MAP_IMPLEMENTATION
+#include "hash_map.h"
+#include "slice.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#define LOOKUPS 1000000
+#define INSERTS 1000000
+
+typedef struct pair {
+  int key, val;
+} pair_t;
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// xorshift, so every run looks up the same keys
+static uint32_t next_rand(uint32_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}
+
+// The baseline: a slice of pointers to (key, value) pairs searched from the
+// front.
+static pair_t *linear_get(slice_t *pairs, int key) {
+  SLICE_FOREACH(pairs, i, val)
+    if(((pair_t *)val)->key == key)
+      return (pair_t *)val;
+  return NULL;
+}
+
+// Looks up LOOKUPS random keys that are all present, first by linear search
+// through a slice and then in a hash map, for a few different amounts of
+// keys. Then inserts INSERTS keys into a map with and without reserving room
+// for them first.
+int main(void) {
+  const int sizes[] = { 8, 64, 512, 4096 };
+  long wrong = 0;
+
+  printf("%6s %14s %14s\n", "keys", "slice ns/get", "map ns/get");
+  for(size_t s = 0; s < sizeof(sizes)/sizeof(sizes[0]); s++) {
+    int n = sizes[s];
+    pair_t *storage = malloc(sizeof(pair_t)*n);
+    slice_t pairs = slice_alloc(n);
+    hash_map_t map = hash_map_alloc(sizeof(int), sizeof(int), 0);
+    for(int i = 0; i < n; i++) {
+      // spread the keys out, so they aren't just 0 to n-1
+      storage[i].key = i*7919 + 1;
+      storage[i].val = i;
+      slice_append(&pairs, &storage[i]);
+      hash_map_put(&map, &storage[i].key, &storage[i].val);
+    }
+
+    long slice_sum = 0, map_sum = 0;
+    uint32_t state = 2463534242u;
+    double start = now();
+    for(int i = 0; i < LOOKUPS; i++) {
+      int key = (int)(next_rand(&state) % n)*7919 + 1;
+      pair_t *found = linear_get(&pairs, key);
+      slice_sum += found != NULL ? found->val : -1;
+    }
+    double slice_took = now() - start;
+
+    state = 2463534242u;
+    start = now();
+    for(int i = 0; i < LOOKUPS; i++) {
+      int key = (int)(next_rand(&state) % n)*7919 + 1;
+      int *found = hash_map_get(&map, &key);
+      map_sum += found != NULL ? *found : -1;
+    }
+    double map_took = now() - start;
+
+    printf("%6d %14.2f %14.2f\n", n, slice_took*1e9/LOOKUPS,
+           map_took*1e9/LOOKUPS);
+    wrong += slice_sum != map_sum;
+    hash_map_free(&map);
+    slice_free(&pairs);
+    free(storage);
+  }
+
+  for(int reserve = 0; reserve < 2; reserve++) {
+    hash_map_t map = hash_map_alloc(sizeof(int), sizeof(int), 0);
+    double start = now();
+    if(reserve)
+      hash_map_reserve(&map, INSERTS);
+    for(int i = 0; i < INSERTS; i++)
+      hash_map_put(&map, &i, &i);
+    double took = now() - start;
+    printf("%d puts %s: %.2f ns per put\n", INSERTS,
+           reserve ? "after hash_map_reserve" : "growing as needed",
+           took*1e9/INSERTS);
+    wrong += map.len != INSERTS;
+    hash_map_free(&map);
+  }
+
+  return wrong != 0;
+}
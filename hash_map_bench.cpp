@@ -0,0 +1,113 @@
+#define QML_HASH_MAP_IMPLEMENTATION
+#include "hash_map.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <unordered_map>
+
+#define LOOKUPS 1000000
+#define INSERTS 1000000
+#define RUNS 5
+
+// an alias keeps the comma out of the BENCH macro's argument
+using std_int_map = std::unordered_map<int, int>;
+
+static double now() {
+  auto t = std::chrono::steady_clock::now().time_since_epoch();
+  return std::chrono::duration<double>(t).count();
+}
+
+// xorshift, so every run looks up the same keys
+static uint32_t next_rand(uint32_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}
+
+// Looks up LOOKUPS random keys that are all present in a hash map and in a
+// std::unordered_map<int, int> holding the same keys, for a few different
+// amounts of keys. Then puts INSERTS keys into both, growing as needed and
+// after reserving room for them first. Keeps the best of a few runs of each.
+int main() {
+  const int sizes[] = { 8, 64, 512, 4096, 65536, 1 << 20 };
+  long wrong = 0;
+  double best, start;
+
+  #define BENCH(body)                                                          \
+    best = 1e9;                                                                \
+    for(int run = 0; run < RUNS; run++) {                                      \
+      start = now();                                                           \
+      body;                                                                    \
+      double took = now() - start;                                             \
+      if(took < best)                                                          \
+        best = took;                                                           \
+    }
+
+  std::printf("%8s %14s %18s\n", "keys", "map ns/get", "unordered ns/get");
+  for(int n : sizes) {
+    hash_map_t map = hash_map_alloc(sizeof(int), sizeof(int), 0);
+    std_int_map std_map;
+    for(int i = 0; i < n; i++) {
+      // spread the keys out, so they aren't just 0 to n-1
+      int key = i*7919 + 1;
+      hash_map_put(&map, &key, &i);
+      std_map[key] = i;
+    }
+
+    long map_sum = 0, std_sum = 0;
+    BENCH({
+      uint32_t state = 2463534242u;
+      map_sum = 0;
+      for(int i = 0; i < LOOKUPS; i++) {
+        int key = (int)(next_rand(&state) % n)*7919 + 1;
+        int *found = (int *)hash_map_get(&map, &key);
+        map_sum += found != NULL ? *found : -1;
+      }
+    });
+    double map_took = best;
+    BENCH({
+      uint32_t state = 2463534242u;
+      std_sum = 0;
+      for(int i = 0; i < LOOKUPS; i++) {
+        int key = (int)(next_rand(&state) % n)*7919 + 1;
+        auto found = std_map.find(key);
+        std_sum += found != std_map.end() ? found->second : -1;
+      }
+    });
+
+    std::printf("%8d %14.2f %18.2f\n", n, map_took*1e9/LOOKUPS,
+                best*1e9/LOOKUPS);
+    wrong += map_sum != std_sum;
+    hash_map_free(&map);
+  }
+
+  for(int reserve = 0; reserve < 2; reserve++) {
+    size_t map_len = 0, std_len = 0;
+    BENCH({
+      hash_map_t map = hash_map_alloc(sizeof(int), sizeof(int), 0);
+      if(reserve)
+        hash_map_reserve(&map, INSERTS);
+      for(int i = 0; i < INSERTS; i++)
+        hash_map_put(&map, &i, &i);
+      map_len = map.len;
+      hash_map_free(&map);
+    });
+    double map_took = best;
+    BENCH({
+      std_int_map std_map;
+      if(reserve)
+        std_map.reserve(INSERTS);
+      for(int i = 0; i < INSERTS; i++)
+        std_map[i] = i;
+      std_len = std_map.size();
+    });
+
+    std::printf("%d puts %s: %.2f ns per put, %.2f with unordered_map\n",
+                INSERTS, reserve ? "after reserving" : "growing as needed",
+                map_took*1e9/INSERTS, best*1e9/INSERTS);
+    wrong += map_len != INSERTS || std_len != INSERTS;
+  }
+
+  return wrong != 0;
+}
@@ -0,0 +1,192 @@
+#define QML_HASH_MAP_IMPLEMENTATION
+#include "hash_map.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Keys and values of sizes that aren't copied or compared as integers.
+typedef struct key3 {
+  unsigned char b[3];
+} key3_t;
+typedef struct val12 {
+  uint32_t a, b, c;
+} val12_t;
+
+#define CHURN_KEYS 100000
+#define CHURN_LIVE 300
+
+key3_t make_key3(uint32_t id) {
+  key3_t key = {{ (unsigned char)id, (unsigned char)(id >> 8),
+                  (unsigned char)(id >> 16) }};
+  return key;
+}
+
+// xorshift, so every run does the same operations
+uint32_t next_rand(uint32_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}
+
+int sum = 0;
+
+int sum_iter_cb(const void *key, void *val) {
+  (void)key;
+  sum += *(int *)val;
+  return 1;
+}
+
+// Puts new keys while removing the oldest ones, so that at most CHURN_LIVE keys
+// are in the map at once, and in between replaces values and removes and puts
+// back random live keys. Every result is checked against plain arrays. The
+// deleted slots left behind fill the table, which then has to be rebuilt at
+// the same size rather than grow.
+int check_churn(void) {
+  static int present[CHURN_KEYS];
+  static val12_t want[CHURN_KEYS];
+  uint32_t oldest = 0, next = 0, state = 2463534242u;
+  size_t len = 0, max_cap = 0, rebuilds = 0;
+  hash_map_t map = hash_map_alloc(sizeof(key3_t), sizeof(val12_t), 0);
+  uint8_t *ctrl = map.ctrl;
+  size_t cap = map.cap;
+  int ok = map.slot_size == 16;
+
+  for(uint32_t step = 0; ok && next < CHURN_KEYS; step++) {
+    // 0 puts a new key or removes the oldest, 1 removes a random key and
+    // anything else puts one, new or not
+    uint32_t op = next_rand(&state) % 4, id;
+    if(op == 0 && next - oldest >= CHURN_LIVE) {
+      id = oldest++;
+      op = 1;
+    } else if(op == 0) {
+      id = next++;
+    } else if(next > oldest) {
+      id = oldest + next_rand(&state) % (next - oldest);
+    } else {
+      continue;
+    }
+    key3_t key = make_key3(id);
+    if(op != 1) {
+      val12_t val = { step, id, ~step };
+      val12_t *stored = hash_map_put(&map, &key, &val);
+      ok = stored != NULL && memcmp(stored, &val, sizeof(val)) == 0;
+      len += !present[id];
+      present[id] = 1;
+      want[id] = val;
+    } else {
+      ok = hash_map_remove(&map, &key) == present[id];
+      len -= present[id];
+      present[id] = 0;
+    }
+    ok = ok && map.len == len;
+    // a removed key has to be gone, and one put back found again
+    val12_t *found = hash_map_get(&map, &key);
+    ok = ok && (present[id] ? found != NULL
+                  && memcmp(found, &want[id], sizeof(*found)) == 0
+                : found == NULL);
+    // a new table of the same capacity means it was rebuilt at the same size
+    rebuilds += map.ctrl != ctrl && map.cap == cap;
+    ctrl = map.ctrl;
+    cap = map.cap;
+    if(map.cap > max_cap)
+      max_cap = map.cap;
+  }
+  for(uint32_t id = 0; ok && id < CHURN_KEYS; id++) {
+    key3_t key = make_key3(id);
+    val12_t *found = hash_map_get(&map, &key);
+    ok = present[id] ? found != NULL
+                       && memcmp(found, &want[id], sizeof(*found)) == 0
+                     : found == NULL;
+  }
+  // 300 keys never need more than 1024 slots, any more and the deleted slots
+  // piled up instead of being cleared out
+  ok = ok && rebuilds > 0 && max_cap <= 1024;
+  hash_map_free(&map);
+  return ok;
+}
+
+// Counts the calls to the callbacks, to check a map uses the ones it's given.
+size_t hash_calls, eq_calls;
+
+// Hashes only the first byte of the key, so that keys with the same first byte
+// always collide and have to be told apart by whole_key_eq_cb.
+uint64_t first_byte_hash_cb(const void *key, size_t key_size) {
+  hash_calls++;
+  return hash_map_hash_bytes(key, key_size > 0);
+}
+
+int whole_key_eq_cb(const void *a, const void *b, size_t key_size) {
+  eq_calls++;
+  return memcmp(a, b, key_size) == 0;
+}
+
+// Checks that reserved room is filled without the table moving, that a
+// cleared map keeps it's memory and finds nothing, and that custom callbacks
+// are used.
+int check_reserve_clear_with(void) {
+  hash_map_t map = hash_map_alloc_with(sizeof(key3_t), sizeof(val12_t), 0,
+                                       first_byte_hash_cb, whole_key_eq_cb);
+  int ok = hash_map_reserve(&map, 1000);
+  uint8_t *ctrl = map.ctrl;
+  size_t cap = map.cap;
+  for(uint32_t id = 0; ok && id < 1000; id++) {
+    key3_t key = make_key3(id);
+    val12_t val = { id, id, id };
+    ok = hash_map_put(&map, &key, &val) != NULL;
+  }
+  ok = ok && map.ctrl == ctrl && map.cap == cap && map.len == 1000
+    && hash_calls >= 1000 && eq_calls > 0;
+  for(uint32_t id = 0; ok && id < 1000; id++) {
+    key3_t key = make_key3(id);
+    val12_t *found = hash_map_get(&map, &key);
+    ok = found != NULL && found->a == id;
+  }
+
+  hash_map_clear(&map);
+  ok = ok && map.len == 0 && map.cap == cap && map.ctrl == ctrl;
+  for(uint32_t id = 0; ok && id < 1000; id++) {
+    key3_t key = make_key3(id);
+    ok = hash_map_get(&map, &key) == NULL;
+  }
+  key3_t key = make_key3(7);
+  val12_t val = { 1, 2, 3 };
+  hash_map_put(&map, &key, &val);
+  val12_t *found = hash_map_get(&map, &key);
+  ok = ok && map.len == 1 && found != NULL && found->c == 3;
+  hash_map_free(&map);
+  return ok;
+}
+
+int main(void) {
+  // map the integers 0-99 to their squares
+  hash_map_t squares = hash_map_alloc(sizeof(int), sizeof(int), 0);
+  for(int i = 0; i < 100; i++) {
+    int square = i*i;
+    hash_map_put(&squares, &i, &square);
+  }
+
+  int key = 12;
+  int *found = hash_map_get(&squares, &key);
+  int twelve = found != NULL ? *found : -1;
+  printf("12 squared is %d.\n", twelve);
+
+  // remove the odd integers, the even ones have to stay findable
+  for(int i = 1; i < 100; i += 2)
+    hash_map_remove(&squares, &i);
+  int wrong = 0;
+  for(int i = 0; i < 100; i++)
+    wrong += (i % 2 == 0) == (hash_map_get(&squares, &i) == NULL);
+  hash_map_iter(&squares, sum_iter_cb);
+  printf("Sum of even squares 0-98 is %d, %d lookups went wrong.\n", sum,
+         wrong);
+
+  hash_map_free(&squares);
+
+  int churn = check_churn();
+  printf("Churn with 3 byte keys and 12 byte values: %s\n",
+         churn ? "OK" : "FAIL");
+  int reserve = check_reserve_clear_with();
+  printf("Reserve, clear and custom callbacks: %s\n", reserve ? "OK" : "FAIL");
+  return twelve != 144 || sum != 161700 || wrong != 0 || !churn || !reserve;
+}
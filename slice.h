@@ -39,16 +39,151 @@ Customising behavior:
   // the slice it it has been freed.
   #define QML_SLICE_ALLOW_AUTO_ALLOC
 
+  // Slices allocated with slice_alloc_aligned that are aligned to a huge page
+  // and take up at least this many bytes are marked with
+  // madvise(MADV_HUGEPAGE) on Linux. Defaults to the size of a single huge
+  // page. This requires compiling with _DEFAULT_SOURCE (or _GNU_SOURCE)
+  // defined, a strict C99 build leaves the hint out.
+  #define QML_HUGEPAGE_THRESHOLD (4*1024*1024)
+
+Aligned storage:
+
+  // the slice's data will be aligned to a cache line, and will stay aligned
+  // when the slice grows or shrinks
+  slice_t my_slice = slice_alloc_aligned(100, QML_ALIGN_CACHE_LINE);
+
+Value slices:
+
+  // store 100 integers in the slice itself, no allocation per element needed
+  val_slice_t my_ints = slice_alloc_val(sizeof(int), 100);
+  for(int i = 0; i < 100; i++)
+    slice_append_val(&my_ints, &i);
+  int *third = slice_get_ptr(&my_ints, 2);
+  slice_free_val(&my_ints);
+
+Inline iteration:
+
+  // the loop body is compiled right into the loop, no callback needed
+  int sum = 0;
+  SLICE_FOREACH(&my_slice, i, val) {
+    if(val == NULL)
+      break;
+    sum += *(int *)val;
+  }
+
+Typed slices:
+
+  // generate slice_double_t and it's functions, usually done once in a header
+  SLICE_DEFINE(double)
+  slice_double_t my_doubles = slice_double_alloc(100);
+  for(int i = 0; i < 100; i++)
+    slice_double_append(&my_doubles, i * 0.5);
+  double *first = slice_double_get(&my_doubles, 0);
+  slice_double_free(&my_doubles);
+
+Sorting:
+
+  // sort with a comparator receiving the stored pointers
+  slice_sort(&my_slice, compare_ints_cb);
+  // or by an integer key, with a radix sort
+  slice_sort_radix(&my_slice, int_key_cb);
+  // or with a comparison inlined into a generated sort function
+  #define DOUBLE_LESS(a, b, ctx) ((a) < (b))
+  SLICE_DEFINE_SORT(sort_doubles, double, DOUBLE_LESS)
+  sort_doubles(my_doubles.data, my_doubles.len, NULL);
+
+Searching sorted slices:
+
+  size_t first = slice_lower_bound(&my_slice, &needle, compare_ints_cb);
+  // an Eytzinger layout is faster to search when it is searched often
+  slice_eytz_t table = slice_eytz_build(&my_slice);
+  int *found = slice_eytz_lower_bound(&table, &needle, compare_ints_cb);
+  slice_eytz_free(&table);
+
+Deques:
+
+  // use a deque as a queue, both ends take constant time
+  slice_deque_t queue = slice_deque_alloc(16);
+  slice_push_back(&queue, first_job);
+  slice_push_front(&queue, urgent_job);
+  struct job *next = slice_pop_front(&queue);
+  slice_deque_free(&queue);
+
+Segmented slices:
+
+  // appending never moves the stored pointers, so their addresses are stable
+  slice_seg_t my_seg = {0};
+  slice_seg_append(&my_seg, some_int);
+  void **where = slice_seg_at(&my_seg, 0);
+  slice_seg_free(&my_seg);
+
+Object pools:
+
+  // take the integers from a pool instead of a malloc call each
+  slice_pool_t pool = slice_pool_alloc(sizeof(int), 1024);
+  for(int i = 0; i < 100; i++) {
+    int *some_int = slice_pool_obj(&pool);
+    *some_int = i;
+    slice_append(&my_slice, some_int);
+  }
+  // frees the slice and every integer
+  slice_free_with_pool(&my_slice, &pool);
+
+Sparse slices:
+
+  // only the page around index 1000000 is allocated
+  slice_sparse_t by_id = {0};
+  slice_sparse_set(&by_id, 1000000, some_int);
+  int *missing = slice_sparse_get(&by_id, 42); // NULL
+  slice_sparse_free(&by_id);
+
+Heaps:
+
+  // keep pending jobs ordered by a comparator, the first one on top
+  slice_heap_push(&pending, new_job, compare_deadlines_cb);
+  struct job *next = slice_heap_pop(&pending, compare_deadlines_cb);
+
+Inserting and removing:
+
+  // moves every value one place to the right
+  slice_insert(&my_slice, 0, some_int);
+  // the last value takes the removed value's place
+  int *removed = slice_swap_remove(&my_slice, 3);
+  // drop every value the callback returns 0 for
+  slice_retain(&my_slice, is_even_iter_cb);
+
+Mapping and filtering:
+
+  // out is grown once to fit every value, then written directly
+  slice_t evens = slice_alloc(0);
+  slice_filter(&evens, &my_slice, is_even_iter_cb);
+  slice_map_in_place(&evens, double_it_map_cb);
+
 */
 
 #ifndef QML_SLICE_DEFINED
 #define QML_SLICE_DEFINED
 
 #include <stddef.h>
+#include <stdint.h>
+
+#ifndef QML_ALIGN_CACHE_LINE
+// Alignment of a single cache line. Slices written to by different threads
+// should be aligned to this to avoid false sharing.
+#define QML_ALIGN_CACHE_LINE 64
+#endif
+
+#ifndef QML_ALIGN_HUGE_PAGE
+// Alignment of a single (transparent) huge page.
+#define QML_ALIGN_HUGE_PAGE (2*1024*1024)
+#endif
 
 typedef struct slice {
   size_t   len, cap;
     void **data;
+  // Alignment of the data in bytes, or 0 if it was allocated with QML_ALLOC
+  // directly.
+  size_t   align;
 } slice_t;
 
 typedef int(slice_iter_cb_t)(size_t idx, void *value);
@@ -56,8 +191,21 @@ typedef int(slice_reduce_cb_t)(void *acc, size_t idx, void *value);
 
 // Allocate a slice on the heap with length 0 and the given capacity.
 slice_t slice_alloc(size_t cap);
+// Allocate a slice like slice_alloc, but with it's data aligned to the given
+// power of two. The alignment is kept when the slice is grown or shrunk.
+slice_t slice_alloc_aligned(size_t cap, size_t align);
 // Append a pointer to the end of the slice, expanding it if necessary.
 void slice_append(slice_t *slice, void *value);
+// Grow the slice, if necessary, so that at least amt more values can be
+// appended without it growing again.
+void slice_reserve(slice_t *slice, size_t amt);
+// Append count pointers from the given array to the end of the slice, growing
+// it at most once.
+void slice_extend(slice_t *slice, void **values, size_t count);
+// Append every value of src to the end of dst, growing it at most once.
+void slice_extend_slice(slice_t *dst, slice_t *src);
+// Append count NULL pointers to the end of the slice, growing it at most once.
+void slice_append_n_null(slice_t *slice, size_t count);
 // Tries to get the value at the given index, this will return NULL if the index
 // is out of bounds or the slice is not valid.
 void *slice_get(slice_t *slice, size_t idx);
@@ -80,44 +228,764 @@ void slice_shrink(slice_t *slice, size_t overhead);
 // Frees the slice's allocated memory and sets it as invalid.
 void slice_free(slice_t *slice);
 
+// Inserting and removing
+//
+// Values after the edited position are moved with a single memmove, so none
+// of these reallocate unless an insert needs more room.
+
+// Insert a value at the given index, moving the values after it one place to
+// the right. The index may be the slice's length, which appends. Returns 0 if
+// the index is out of bounds.
+int slice_insert(slice_t *slice, size_t idx, void *value);
+// Insert count values at the given index, like slice_insert. Returns 0 if the
+// index is out of bounds.
+int slice_insert_n(slice_t *slice, size_t idx, void **values, size_t count);
+// Remove the value at the given index and return it, moving the values after
+// it one place to the left. Returns NULL if the index is out of bounds.
+void *slice_remove(slice_t *slice, size_t idx);
+// Remove up to count values starting at the given index. Returns the number
+// of values that were actually removed.
+size_t slice_remove_range(slice_t *slice, size_t idx, size_t count);
+// Remove the value at the given index and return it, moving the last value
+// into it's place. This does not keep the order of the values, but takes
+// constant time. Returns NULL if the index is out of bounds.
+void *slice_swap_remove(slice_t *slice, size_t idx);
+// Keep only the values for which pred returns non-zero, in their original
+// order. pred receives every value's index from before the call. Returns the
+// slice's new length.
+size_t slice_retain(slice_t *slice, slice_iter_cb_t pred);
+
+// Mapping and filtering
+//
+// These append their results to an output slice, which is grown once up front
+// to fit every value of the input, so the results are written directly. The
+// output must not be the input slice itself, use the in place variants for
+// that.
+
+// Returns the value to store in place of the given (index, pointer) pair.
+typedef void *(slice_map_cb_t)(size_t idx, void *value);
+// Stores the value to keep in place of the given (index, pointer) pair in out
+// and returns non-zero, or returns 0 to drop the value.
+typedef int(slice_filter_map_cb_t)(size_t idx, void *value, void **out);
+
+// Append the value returned by map for every value of in to out.
+void slice_map(slice_t *out, slice_t *in, slice_map_cb_t map);
+// Append every value of in for which pred returns non-zero to out.
+void slice_filter(slice_t *out, slice_t *in, slice_iter_cb_t pred);
+// Append the value filter_map stores for every value of in it returns
+// non-zero for to out.
+void slice_filter_map(slice_t *out, slice_t *in, slice_filter_map_cb_t cb);
+// Same as slice_map, replacing the slice's values with the results instead of
+// allocating another slice.
+void slice_map_in_place(slice_t *slice, slice_map_cb_t map);
+// Same as slice_filter_map, replacing the slice's values with the results
+// instead of allocating another slice. Returns the slice's new length. To
+// only filter in place, use slice_retain.
+size_t slice_filter_map_in_place(slice_t *slice, slice_filter_map_cb_t cb);
+
+// A slice storing the elements themselves rather than pointers to them. Every
+// element takes up elem_size bytes and they are laid out next to each other.
+typedef struct val_slice {
+  size_t   len, cap;
+    char  *data;
+  size_t   elem_size, align;
+} val_slice_t;
+
+// Allocate a value slice on the heap with length 0 and room for cap elements
+// of elem_size bytes each.
+val_slice_t slice_alloc_val(size_t elem_size, size_t cap);
+// Allocate a value slice like slice_alloc_val, with it's data aligned to the
+// given power of two.
+val_slice_t slice_alloc_val_aligned(size_t elem_size, size_t cap,
+                                    size_t align);
+// Copy elem_size bytes from value to the end of the slice, expanding it if
+// necessary.
+void slice_append_val(val_slice_t *slice, const void *value);
+// Get a pointer to the element at the given index, or NULL if the index is out
+// of bounds or the slice is not valid. The pointer is invalidated when the
+// slice grows.
+void *slice_get_ptr(val_slice_t *slice, size_t idx);
+// Copy elem_size bytes from value to the given index, expanding the slice if
+// necessary and zeroing the elements in between.
+void slice_set_val(val_slice_t *slice, size_t idx, const void *value);
+// Same as slice_iter, with the callback receiving a pointer to each element.
+void slice_iter_val(val_slice_t *slice, slice_iter_cb_t cb);
+// Same as slice_reduce, with the callback receiving a pointer to each element.
+void slice_reduce_val(val_slice_t *slice, void *acc, slice_reduce_cb_t cb);
+// Same as slice_shrink, for value slices.
+void slice_shrink_val(val_slice_t *slice, size_t overhead);
+// Frees the value slice's allocated memory and sets it as invalid. The element
+// size is kept.
+void slice_free_val(val_slice_t *slice);
+
+// Deques
+//
+// A deque stores pointers in a ring, so values can be pushed and popped at
+// both ends in constant time. The capacity is always a power of two and
+// indices wrap around with a mask. A zeroed deque is valid and empty.
+
+typedef struct slice_deque {
+  size_t   head, len, cap;
+    void **data;
+} slice_deque_t;
+
+// Allocate a deque on the heap with length 0 and room for at least cap
+// values. The capacity is rounded up to a power of two.
+slice_deque_t slice_deque_alloc(size_t cap);
+// Add a value to the front of the deque, expanding it if necessary.
+void slice_push_front(slice_deque_t *deque, void *value);
+// Add a value to the back of the deque, expanding it if necessary.
+void slice_push_back(slice_deque_t *deque, void *value);
+// Remove the value at the front of the deque and return it, or NULL if the
+// deque is empty.
+void *slice_pop_front(slice_deque_t *deque);
+// Remove the value at the back of the deque and return it, or NULL if the
+// deque is empty.
+void *slice_pop_back(slice_deque_t *deque);
+// Tries to get the value at the given index, counting from the front. This
+// will return NULL if the index is out of bounds.
+void *slice_deque_get(slice_deque_t *deque, size_t idx);
+// Same as slice_iter, going from the front of the deque to the back.
+void slice_deque_iter(slice_deque_t *deque, slice_iter_cb_t cb);
+// Same as slice_reduce, going from the front of the deque to the back.
+void slice_deque_reduce(slice_deque_t *deque, void *acc, slice_reduce_cb_t cb);
+// Frees the deque's allocated memory and sets it as invalid.
+void slice_deque_free(slice_deque_t *deque);
+
+// Segmented slices
+//
+// A segmented slice stores pointers in blocks that are never moved once they
+// are allocated, so growing it never copies anything and the address of a
+// stored pointer stays valid until the slice is freed. The first block holds
+// QML_SLICE_SEG_FIRST pointers and each block after it is twice as large as
+// the one before, so an index is turned into a block and an offset with a
+// couple of bit operations. A zeroed segmented slice is valid and empty.
+
+#ifndef QML_SLICE_SEG_FIRST_SHIFT
+// The size of the first block of a segmented slice, as a power of two.
+#define QML_SLICE_SEG_FIRST_SHIFT 6
 #endif
+#define QML_SLICE_SEG_FIRST ((size_t)1 << QML_SLICE_SEG_FIRST_SHIFT)
+#define QML_SLICE_SEG_BLOCKS (sizeof(size_t)*8 - QML_SLICE_SEG_FIRST_SHIFT)
 
-#define QML_SLICE_IMPLEMENTATION
-#define QML_SLICE_ALLOW_AUTO_ALLOC
+typedef struct slice_seg {
+  size_t   len, cap;
+    void **blocks[QML_SLICE_SEG_BLOCKS];
+} slice_seg_t;
+
+// Append a pointer to the end of the segmented slice, allocating a new block
+// if the last one is full.
+void slice_seg_append(slice_seg_t *seg, void *value);
+// Tries to get the value at the given index, this will return NULL if the index
+// is out of bounds.
+void *slice_seg_get(slice_seg_t *seg, size_t idx);
+// Get the address of the value at the given index, or NULL if the index is out
+// of bounds. The address stays valid until the segmented slice is freed.
+void **slice_seg_at(slice_seg_t *seg, size_t idx);
+// Same as slice_iter, for segmented slices.
+void slice_seg_iter(slice_seg_t *seg, slice_iter_cb_t cb);
+// Same as slice_reduce, for segmented slices.
+void slice_seg_reduce(slice_seg_t *seg, void *acc, slice_reduce_cb_t cb);
+// Frees every block of the segmented slice and sets it as empty.
+void slice_seg_free(slice_seg_t *seg);
+
+// Object pools
+//
+// A pool hands out fixed-size objects from large blocks, so the values a slice
+// points to can be allocated without a QML_ALLOC call each and freed all at
+// once. Objects taken one after another sit next to each other in memory,
+// which keeps iterating over the slice cache friendly.
+
+typedef struct slice_pool {
+  size_t   obj_size, block_cap, used;
+  // The newest block, which starts with a pointer to the one before it.
+    char  *block;
+  // Objects given back with slice_pool_release, linked through their first
+  // bytes.
+    void  *free_list;
+} slice_pool_t;
+
+// Create an empty pool of objects of obj_size bytes, allocating block_cap of
+// them at a time. Nothing is allocated until the first object is taken.
+slice_pool_t slice_pool_alloc(size_t obj_size, size_t block_cap);
+// Take an object from the pool, allocating a new block if necessary. Objects
+// are aligned like a pointer.
+void *slice_pool_obj(slice_pool_t *pool);
+// Give an object back to the pool, so that it can be taken again.
+void slice_pool_release(slice_pool_t *pool, void *obj);
+// Frees every block of the pool, and with them every object taken from it.
+void slice_pool_free(slice_pool_t *pool);
+// Frees the slice and the pool holding it's values in one call.
+void slice_free_with_pool(slice_t *slice, slice_pool_t *pool);
+
+// Sparse slices
+//
+// A sparse slice splits it's values into pages of QML_SLICE_SPARSE_PAGE
+// pointers and only allocates the pages a value has been set in. Every other
+// index reads as NULL, so setting a far out index costs a single page rather
+// than memory for every index before it. A zeroed sparse slice is valid and
+// empty.
+
+#ifndef QML_SLICE_SPARSE_PAGE_SHIFT
+// The number of pointers in a page of a sparse slice, as a power of two.
+// Defaults to 4KiB worth of pointers on 64-bit platforms.
+#define QML_SLICE_SPARSE_PAGE_SHIFT 9
+#endif
+#define QML_SLICE_SPARSE_PAGE ((size_t)1 << QML_SLICE_SPARSE_PAGE_SHIFT)
+
+typedef struct slice_sparse {
+  // One past the highest index that has been set.
+  size_t   len;
+  // The pages, with NULL for those that were never written to.
+  slice_t  pages;
+} slice_sparse_t;
+
+// Tries to get the value at the given index, this will return NULL if the index
+// is out of bounds or has not been set.
+void *slice_sparse_get(slice_sparse_t *sparse, size_t idx);
+// Sets the given index to the given value, allocating it's page if it was not
+// written to before. The length is extended to cover the index like
+// slice_set, but the indices in between are not allocated.
+void slice_sparse_set(slice_sparse_t *sparse, size_t idx, void *value);
+// Same as slice_iter, but only calls the callback for values that are not
+// NULL, skipping pages that were never allocated entirely.
+void slice_sparse_iter(slice_sparse_t *sparse, slice_iter_cb_t cb);
+// Same as slice_reduce, skipping NULL values like slice_sparse_iter.
+void slice_sparse_reduce(slice_sparse_t *sparse, void *acc,
+                         slice_reduce_cb_t cb);
+// Frees every page of the sparse slice and sets it as empty.
+void slice_sparse_free(slice_sparse_t *sparse);
+
+// Inline iteration
+//
+// slice_iter and slice_reduce call their callback through a pointer for every
+// element. The functions and macros below are defined in the header, so the
+// loop body or callback can be inlined at the call site instead.
+
+// Same as slice_iter, but defined inline so that a callback known at compile
+// time can be inlined into the loop.
+static inline void slice_iter_inline(slice_t *slice, slice_iter_cb_t cb) {
+  for(size_t i = 0; i < slice->len; i++)
+    if(!cb(i, slice->data[i]))
+      break;
+}
+
+// Same as slice_reduce, but defined inline like slice_iter_inline.
+static inline void slice_reduce_inline(slice_t *slice, void *acc,
+                                       slice_reduce_cb_t cb) {
+  for(size_t i = 0; i < slice->len; i++)
+    if(!cb(acc, i, slice->data[i]))
+      break;
+}
+
+// Loops over every (index, pointer) pair of a slice_t, declaring idx as a
+// size_t and val as a void*. break and continue work like in a normal loop.
+//
+//   SLICE_FOREACH(&my_slice, i, val) {
+//     sum += *(int *)val;
+//   }
+#define SLICE_FOREACH(slice, idx, val)                                         \
+  for(size_t idx = 0, _qml_brk_##idx = 0;                                      \
+      !_qml_brk_##idx && idx < (slice)->len; idx++)                            \
+    for(void *val = (_qml_brk_##idx = 1, (slice)->data[idx]);                  \
+        _qml_brk_##idx; _qml_brk_##idx = 0)
+
+// Loops over every element of a val_slice_t, declaring idx as a size_t and ptr
+// as a pointer to the element, which has to be of type T.
+#define SLICE_FOREACH_VAL(slice, idx, T, ptr)                                  \
+  for(size_t idx = 0, _qml_brk_##idx = 0;                                      \
+      !_qml_brk_##idx && idx < (slice)->len; idx++)                            \
+    for(T *ptr = (_qml_brk_##idx = 1,                                          \
+                  (T *)((slice)->data + (slice)->elem_size*idx));              \
+        _qml_brk_##idx; _qml_brk_##idx = 0)
 
-#ifdef QML_SLICE_IMPLEMENTATION
+// Loops over every element of a slice generated by SLICE_DEFINE(T), declaring
+// idx as a size_t and ptr as a pointer to the element.
+#define SLICE_FOREACH_TYPED(slice, idx, T, ptr)                                \
+  for(size_t idx = 0, _qml_brk_##idx = 0;                                      \
+      !_qml_brk_##idx && idx < (slice)->len; idx++)                            \
+    for(T *ptr = (_qml_brk_##idx = 1, &(slice)->data[idx]);                    \
+        _qml_brk_##idx; _qml_brk_##idx = 0)
 
-#ifndef QML_ALLOC
+// Typed slices
+//
+// SLICE_DEFINE(T) generates a slice_T_t type holding elements of type T along
+// with static inline functions operating on it. Since the element type is
+// known at compile time, loops over typed slices can be inlined and
+// vectorized. For types whose name is not a single identifier, use
+// SLICE_DEFINE_NAMED(T, name) to generate slice_name_t instead. A zeroed typed
+// slice is valid and empty.
+
+// Everything in this header allocates through these, which are QML_ALLOC,
+// QML_REALLOC and QML_FREE if they were defined before including it, or the
+// stdlib functions otherwise. The hooks themselves are left undefined, so
+// headers included later still fall back to their own defaults.
+#ifdef QML_ALLOC
+#define _SLICE_ALLOC QML_ALLOC
+#else
 #include <stdlib.h>
-#define QML_ALLOC malloc
+#define _SLICE_ALLOC malloc
 #endif
 
-#ifndef QML_REALLOC
+#ifdef QML_REALLOC
+#define _SLICE_REALLOC QML_REALLOC
+#else
 #include <stdlib.h>
-#define QML_REALLOC realloc
+#define _SLICE_REALLOC realloc
 #endif
 
-#ifndef QML_FREE
+#ifdef QML_FREE
+#define _SLICE_FREE QML_FREE
+#else
 #include <stdlib.h>
-#define QML_FREE free
+#define _SLICE_FREE free
 #endif
 
+#include <string.h>
+
+#define SLICE_DEFINE(T) SLICE_DEFINE_NAMED(T, T)
+
+#define SLICE_DEFINE_NAMED(T, name)                                            \
+typedef struct slice_##name {                                                  \
+  size_t len, cap;                                                             \
+  T     *data;                                                                 \
+} slice_##name##_t;                                                            \
+                                                                               \
+/* Allocate a slice on the heap with length 0 and the given capacity. */       \
+static inline slice_##name##_t slice_##name##_alloc(size_t cap) {              \
+  if(cap == 0)                                                                 \
+    cap = 1;                                                                   \
+  return (slice_##name##_t){ 0, cap, (T *)_SLICE_ALLOC(sizeof(T)*cap) };       \
+}                                                                              \
+                                                                               \
+/* Make sure at least amt more elements fit without growing again. */          \
+static inline void slice_##name##_reserve(slice_##name##_t *slice,             \
+                                          size_t amt) {                        \
+  if(slice->len + amt <= slice->cap)                                           \
+    return;                                                                    \
+  size_t cap = slice->cap + slice->cap/2;                                      \
+  if(cap < slice->len + amt)                                                   \
+    cap = slice->len + amt;                                                    \
+  slice->data = (T *)_SLICE_REALLOC(slice->data, sizeof(T)*cap);               \
+  slice->cap = cap;                                                            \
+}                                                                              \
+                                                                               \
+/* Append a value to the end of the slice, expanding it if necessary. */       \
+static inline void slice_##name##_append(slice_##name##_t *slice, T value) {   \
+  if(slice->len == slice->cap)                                                 \
+    slice_##name##_reserve(slice, 1);                                          \
+  slice->data[slice->len++] = value;                                           \
+}                                                                              \
+                                                                               \
+/* Get a pointer to the element at the given index, or NULL if the index is   \
+   out of bounds. */                                                           \
+static inline T *slice_##name##_get(slice_##name##_t *slice, size_t idx) {     \
+  if(idx >= slice->len)                                                        \
+    return NULL;                                                               \
+  return &slice->data[idx];                                                    \
+}                                                                              \
+                                                                               \
+/* Set the element at the given index, expanding the slice if necessary and   \
+   zeroing the elements in between. */                                         \
+static inline void slice_##name##_set(slice_##name##_t *slice, size_t idx,     \
+                                      T value) {                               \
+  if(idx >= slice->len) {                                                      \
+    slice_##name##_reserve(slice, idx+1 - slice->len);                         \
+    memset(slice->data + slice->len, 0, sizeof(T)*(idx - slice->len));        \
+    slice->len = idx+1;                                                        \
+  }                                                                            \
+  slice->data[idx] = value;                                                    \
+}                                                                              \
+                                                                               \
+/* Shrink the slice's capacity to it's length plus the given overhead. */      \
+static inline void slice_##name##_shrink(slice_##name##_t *slice,              \
+                                         size_t overhead) {                    \
+  slice->cap = slice->len + overhead;                                          \
+  if(slice->cap == 0)                                                          \
+    slice->cap = 1;                                                            \
+  slice->data = (T *)_SLICE_REALLOC(slice->data, sizeof(T)*slice->cap);        \
+}                                                                              \
+                                                                               \
+/* Free the slice's memory, leaving it empty. */                               \
+static inline void slice_##name##_free(slice_##name##_t *slice) {              \
+  _SLICE_FREE(slice->data);                                                    \
+  slice->data = NULL;                                                          \
+  slice->len = 0;                                                              \
+  slice->cap = 0;                                                              \
+}
+
+// Sorting
+
+// Compares two values stored in a slice, returning a negative number if a
+// should come before b, a positive number if it should come after and 0 if
+// their order does not matter.
+typedef int(slice_cmp_cb_t)(void *a, void *b);
+// Extracts an unsigned integer key from a value stored in a slice.
+typedef uint64_t(slice_key_cb_t)(void *value);
+
+// Sort the slice's values in place with an introsort, so it never takes more
+// than O(n log n) comparisons. The order of equal values is not kept.
+void slice_sort(slice_t *slice, slice_cmp_cb_t cmp);
+// Sort the slice's values in place by the keys returned by key, with an LSD
+// radix sort. The key is only extracted once per value, and bytes which all
+// keys have in common are skipped. The order of values with equal keys is
+// kept. Returns 0 if the temporary memory could not be allocated, in which
+// case the slice is left untouched.
+int slice_sort_radix(slice_t *slice, slice_key_cb_t key);
+
+// Searching and set operations
+//
+// The functions below expect their slices to be sorted by the same comparator
+// they are given.
+
+// Get the index of the first value that is not less than the given value, or
+// the slice's length if there is none. Uses a branchless binary search.
+size_t slice_lower_bound(slice_t *slice, void *value, slice_cmp_cb_t cmp);
+// Get the index of the first value that is greater than the given value, or
+// the slice's length if there is none.
+size_t slice_upper_bound(slice_t *slice, void *value, slice_cmp_cb_t cmp);
+// Remove every value that compares equal to the one before it, keeping the
+// first of each run. Returns the slice's new length.
+size_t slice_unique(slice_t *slice, slice_cmp_cb_t cmp);
+// Append the values of both slices to out, in sorted order. Values that
+// compare equal are taken from a first.
+void slice_merge(slice_t *out, slice_t *a, slice_t *b, slice_cmp_cb_t cmp);
+// Append the values of a which have an equal value in b to out. Every value of
+// b is matched at most once, so a value that is in a three times and in b twice
+// is appended twice.
+void slice_intersect(slice_t *out, slice_t *a, slice_t *b, slice_cmp_cb_t cmp);
+// Append the values of a which have no equal value in b to out. Like
+// slice_intersect, every value of b cancels out only one equal value of a.
+void slice_difference(slice_t *out, slice_t *a, slice_t *b,
+                      slice_cmp_cb_t cmp);
+
+// A copy of a sorted slice laid out in Eytzinger (breadth-first) order. Every
+// step of a search moves further into the array, so the next few steps can be
+// prefetched, which makes it faster than a binary search over large read-only
+// tables.
+typedef struct slice_eytz {
+  size_t   len;
+    void **data;
+} slice_eytz_t;
+
+// Build an Eytzinger layout of the sorted slice. The slice is left untouched.
+slice_eytz_t slice_eytz_build(slice_t *sorted);
+// Get the first value in the layout which is not less than the given value, or
+// NULL if there is none.
+void *slice_eytz_lower_bound(slice_eytz_t *eytz, void *value,
+                             slice_cmp_cb_t cmp);
+// Frees the layout's memory.
+void slice_eytz_free(slice_eytz_t *eytz);
+
+// SLICE_DEFINE_SORT(name, T, less) generates an introsort over an array of T,
+// with the comparison inlined:
+//
+//   static inline void name(T *data, size_t len, void *ctx);
+//
+// less(a, b, ctx) has to evaluate to non-zero if a should come before b. It
+// can be a macro or a function, and ctx is passed through from the caller.
+//
+//   #define INT_LESS(a, b, ctx) ((a) < (b))
+//   SLICE_DEFINE_SORT(sort_ints, int, INT_LESS)
+//   sort_ints(my_ints.data, my_ints.len, NULL);
+#define SLICE_DEFINE_SORT(name, T, less)                                       \
+static inline void name##_insertion(T *data, size_t len, void *ctx) {          \
+  (void)ctx;                                                                   \
+  for(size_t i = 1; i < len; i++) {                                            \
+    T val = data[i];                                                           \
+    size_t j = i;                                                              \
+    for(; j > 0 && less(val, data[j-1], ctx); j--)                             \
+      data[j] = data[j-1];                                                     \
+    data[j] = val;                                                             \
+  }                                                                            \
+}                                                                              \
+                                                                               \
+static inline void name##_sift(T *data, size_t root, size_t len, void *ctx) {  \
+  (void)ctx;                                                                   \
+  T val = data[root];                                                          \
+  for(;;) {                                                                    \
+    size_t child = 2*root + 1;                                                 \
+    if(child >= len)                                                           \
+      break;                                                                   \
+    if(child+1 < len && less(data[child], data[child+1], ctx))                 \
+      child++;                                                                 \
+    if(!less(val, data[child], ctx))                                           \
+      break;                                                                   \
+    data[root] = data[child];                                                  \
+    root = child;                                                              \
+  }                                                                            \
+  data[root] = val;                                                            \
+}                                                                              \
+                                                                               \
+static inline void name##_heapsort(T *data, size_t len, void *ctx) {           \
+  for(size_t i = len/2; i-- > 0;)                                              \
+    name##_sift(data, i, len, ctx);                                            \
+  for(size_t i = len; i-- > 1;) {                                              \
+    T tmp = data[0];                                                           \
+    data[0] = data[i];                                                         \
+    data[i] = tmp;                                                             \
+    name##_sift(data, 0, i, ctx);                                              \
+  }                                                                            \
+}                                                                              \
+                                                                               \
+static inline void name##_intro(T *data, size_t len, size_t depth,             \
+                                void *ctx) {                                   \
+  (void)ctx;                                                                   \
+  while(len > 16) {                                                            \
+    /* too many bad pivots, fall back to heapsort */                           \
+    if(depth-- == 0) {                                                         \
+      name##_heapsort(data, len, ctx);                                         \
+      return;                                                                  \
+    }                                                                          \
+                                                                               \
+    /* median of three, which also leaves sentinels at both ends */            \
+    size_t mid = len/2, last = len-1;                                          \
+    T tmp;                                                                     \
+    if(less(data[mid], data[0], ctx)) {                                        \
+      tmp = data[mid]; data[mid] = data[0]; data[0] = tmp;                     \
+    }                                                                          \
+    if(less(data[last], data[mid], ctx)) {                                     \
+      tmp = data[last]; data[last] = data[mid]; data[mid] = tmp;               \
+      if(less(data[mid], data[0], ctx)) {                                      \
+        tmp = data[mid]; data[mid] = data[0]; data[0] = tmp;                   \
+      }                                                                        \
+    }                                                                          \
+    T pivot = data[mid];                                                       \
+                                                                               \
+    size_t i = 0, j = len-1;                                                   \
+    for(;;) {                                                                  \
+      while(less(data[++i], pivot, ctx));                                      \
+      while(less(pivot, data[--j], ctx));                                      \
+      if(i >= j)                                                               \
+        break;                                                                 \
+      tmp = data[i]; data[i] = data[j]; data[j] = tmp;                         \
+    }                                                                          \
+                                                                               \
+    /* recurse into the smaller half to keep the stack shallow */              \
+    if(i < len-i) {                                                            \
+      name##_intro(data, i, depth, ctx);                                       \
+      data += i;                                                               \
+      len -= i;                                                                \
+    } else {                                                                   \
+      name##_intro(data + i, len-i, depth, ctx);                               \
+      len = i;                                                                 \
+    }                                                                          \
+  }                                                                            \
+  name##_insertion(data, len, ctx);                                            \
+}                                                                              \
+                                                                               \
+static inline void name(T *data, size_t len, void *ctx) {                      \
+  size_t depth = 0;                                                            \
+  for(size_t n = len; n > 1; n >>= 1)                                          \
+    depth += 2;                                                                \
+  name##_intro(data, len, depth, ctx);                                         \
+}
+
+// Heaps
+//
+// A heap keeps a slice arranged so that the value which comes first according
+// to a comparator is always at index 0, and can be taken out or added in
+// O(log n) time. Every node has QML_SLICE_HEAP_ARITY children, a 4-ary heap
+// is shallower and keeps a node's children on one cache line.
+
+#ifndef QML_SLICE_HEAP_ARITY
+// Number of children of every node of the heaps built by the slice_heap_
+// functions. Defaults to 2.
+#define QML_SLICE_HEAP_ARITY 2
+#endif
+
+// Arrange the slice's values into a heap, in O(n) time.
+void slice_heapify(slice_t *slice, slice_cmp_cb_t cmp);
+// Add a value to the heap, expanding the slice if necessary.
+void slice_heap_push(slice_t *slice, void *value, slice_cmp_cb_t cmp);
+// Remove the value that comes first from the heap and return it, or NULL if
+// the heap is empty.
+void *slice_heap_pop(slice_t *slice, slice_cmp_cb_t cmp);
+// Replace the value at the given index with one that does not come after it,
+// moving it towards the top of the heap as far as needed. Does nothing if the
+// index is out of bounds.
+void slice_heap_decrease(slice_t *slice, size_t idx, void *value,
+                         slice_cmp_cb_t cmp);
+
+// SLICE_DEFINE_HEAP(name, T, less, arity) generates heap functions over an
+// array of T, with the comparison inlined and arity children per node:
+//
+//   // arrange data into a heap
+//   static inline void name_heapify(T *data, size_t len, void *ctx);
+//   // data[len-1] was just added to the heap data[0..len-2]
+//   static inline void name_push(T *data, size_t len, void *ctx);
+//   // move the first value to data[len-1], leaving a heap of len-1 values
+//   static inline void name_pop(T *data, size_t len, void *ctx);
+//   // data[idx] was replaced by a value that does not come after it
+//   static inline void name_sift_up(T *data, size_t idx, void *ctx);
+//
+// less is used like in SLICE_DEFINE_SORT, the value that is less than every
+// other is kept at data[0].
+//
+//   #define JOB_LESS(a, b, ctx) ((a).deadline < (b).deadline)
+//   SLICE_DEFINE_HEAP(job_heap, struct job, JOB_LESS, 4)
+//   slice_job_append(&jobs, new_job);
+//   job_heap_push(jobs.data, jobs.len, NULL);
+//   job_heap_pop(jobs.data, jobs.len, NULL);
+//   struct job next = jobs.data[--jobs.len];
+#define SLICE_DEFINE_HEAP(name, T, less, arity)                                \
+static inline void name##_sift_up(T *data, size_t idx, void *ctx) {            \
+  (void)ctx;                                                                   \
+  T val = data[idx];                                                           \
+  while(idx > 0) {                                                             \
+    size_t parent = (idx-1) / (arity);                                         \
+    if(!less(val, data[parent], ctx))                                          \
+      break;                                                                   \
+    data[idx] = data[parent];                                                  \
+    idx = parent;                                                              \
+  }                                                                            \
+  data[idx] = val;                                                             \
+}                                                                              \
+                                                                               \
+static inline void name##_sift_down(T *data, size_t len, size_t idx,           \
+                                    void *ctx) {                               \
+  (void)ctx;                                                                   \
+  T val = data[idx];                                                           \
+  for(;;) {                                                                    \
+    size_t first = (arity)*idx + 1;                                            \
+    if(first >= len)                                                           \
+      break;                                                                   \
+    size_t end = len - first > (arity) ? first + (arity) : len;                \
+    size_t best = first;                                                       \
+    for(size_t child = first+1; child < end; child++)                          \
+      if(less(data[child], data[best], ctx))                                   \
+        best = child;                                                          \
+    if(!less(data[best], val, ctx))                                            \
+      break;                                                                   \
+    data[idx] = data[best];                                                    \
+    idx = best;                                                                \
+  }                                                                            \
+  data[idx] = val;                                                             \
+}                                                                              \
+                                                                               \
+static inline void name##_heapify(T *data, size_t len, void *ctx) {            \
+  if(len < 2)                                                                  \
+    return;                                                                    \
+  /* sift down every node that has children, starting from the last one */    \
+  for(size_t i = (len-2) / (arity) + 1; i-- > 0;)                              \
+    name##_sift_down(data, len, i, ctx);                                       \
+}                                                                              \
+                                                                               \
+static inline void name##_push(T *data, size_t len, void *ctx) {               \
+  if(len > 1)                                                                  \
+    name##_sift_up(data, len-1, ctx);                                          \
+}                                                                              \
+                                                                               \
+static inline void name##_pop(T *data, size_t len, void *ctx) {                \
+  if(len < 2)                                                                  \
+    return;                                                                    \
+  T top = data[0];                                                             \
+  data[0] = data[len-1];                                                       \
+  data[len-1] = top;                                                           \
+  name##_sift_down(data, len-1, 0, ctx);                                       \
+}
+
+#endif
+
+#define QML_SLICE_IMPLEMENTATION
+#define QML_SLICE_ALLOW_AUTO_ALLOC
+
+#if defined(QML_SLICE_IMPLEMENTATION) && !defined(QML_SLICE_IMPLEMENTED)
+#define QML_SLICE_IMPLEMENTED
+
+#include <stdint.h>
+#include <string.h>
+
+#ifndef QML_HUGEPAGE_THRESHOLD
+#define QML_HUGEPAGE_THRESHOLD QML_ALIGN_HUGE_PAGE
+#endif
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+// Allocates size bytes aligned to align using QML_ALLOC. The pointer returned
+// by QML_ALLOC is stored right before the aligned data, so that it can be
+// given back to QML_FREE later.
+static void *_slice_aligned_alloc(size_t size, size_t align) {
+  if(align < sizeof(void*))
+    align = sizeof(void*);
+  char *base = (char *)_SLICE_ALLOC(size + align - 1 + sizeof(void*));
+  if(base == NULL)
+    return NULL;
+  uintptr_t addr = (uintptr_t)(base + sizeof(void*));
+  addr = (addr + align - 1) & ~(uintptr_t)(align - 1);
+  ((void **)addr)[-1] = base;
+
+  // MADV_HUGEPAGE is only visible with _DEFAULT_SOURCE or _GNU_SOURCE
+  #if defined(__linux__) && defined(MADV_HUGEPAGE)
+    if(align >= QML_ALIGN_HUGE_PAGE && size >= QML_HUGEPAGE_THRESHOLD)
+      madvise((void *)addr, size, MADV_HUGEPAGE);
+  #endif
+
+  return (void *)addr;
+}
+
+static void _slice_aligned_free(void *data) {
+  _SLICE_FREE(((void **)data)[-1]);
+}
+
+// Resizes memory allocated with QML_ALLOC or _slice_aligned_alloc to size
+// bytes, keeping the first used bytes and the alignment.
+static void *_slice_resize(void *data, size_t used, size_t size, size_t align) {
+  if(align == 0)
+    return _SLICE_REALLOC(data, size);
+
+  // like realloc, the old memory is left alone if this fails
+  void *out = _slice_aligned_alloc(size, align);
+  if(out == NULL)
+    return NULL;
+  if(data != NULL) {
+    memcpy(out, data, used < size ? used : size);
+    _slice_aligned_free(data);
+  }
+  return out;
+}
+
+static void _slice_release(void *data, size_t align) {
+  if(align == 0)
+    _SLICE_FREE(data);
+  else
+    _slice_aligned_free(data);
+}
+
+// Resizes the slice's underlying memory to it's current capacity, keeping the
+// alignment if it has one.
+static void _slice_realloc(slice_t *slice) {
+  slice->data = (void**)_slice_resize(slice->data, sizeof(void*)*slice->len,
+                                      sizeof(void*)*slice->cap, slice->align);
+}
+
 slice_t slice_alloc(size_t cap) {
   if(cap == 0)
     cap = 1;
-  return (slice_t){ 0, cap, (void**)QML_ALLOC(sizeof(void*)*cap) };
+  return (slice_t){ 0, cap, (void**)_SLICE_ALLOC(sizeof(void*)*cap), 0 };
+}
+
+slice_t slice_alloc_aligned(size_t cap, size_t align) {
+  if(align == 0)
+    return slice_alloc(cap);
+  if(cap == 0)
+    cap = 1;
+  void **data = (void**)_slice_aligned_alloc(sizeof(void*)*cap, align);
+  return (slice_t){ 0, cap, data, align };
 }
 
 void _slice_maybe_grow(slice_t *slice, size_t amt) {
   #ifdef QML_SLICE_ALLOW_AUTO_ALLOC
-    if(slice->cap == 0 || slice->data == NULL) {
-      *slice = slice_alloc(amt);
+    if(slice->data == NULL) {
+      *slice = slice_alloc_aligned(amt, slice->align);
     }
   #endif
 
   if(slice->len + amt >= slice->cap) {
     slice->cap += slice->cap/2 + amt;
-    slice->data = (void**)QML_REALLOC(slice->data, sizeof(void*)*slice->cap);
+    _slice_realloc(slice);
   }
 }
 
@@ -126,6 +994,30 @@ void slice_append(slice_t *slice, void *value) {
   slice->data[slice->len++] = value;
 }
 
+void slice_reserve(slice_t *slice, size_t amt) {
+  _slice_maybe_grow(slice, amt);
+}
+
+void slice_extend(slice_t *slice, void **values, size_t count) {
+  _slice_maybe_grow(slice, count);
+  memcpy(slice->data + slice->len, values, sizeof(void*)*count);
+  slice->len += count;
+}
+
+void slice_extend_slice(slice_t *dst, slice_t *src) {
+  // src->data may move if dst and src are the same slice
+  size_t count = src->len;
+  _slice_maybe_grow(dst, count);
+  memcpy(dst->data + dst->len, src->data, sizeof(void*)*count);
+  dst->len += count;
+}
+
+void slice_append_n_null(slice_t *slice, size_t count) {
+  _slice_maybe_grow(slice, count);
+  memset(slice->data + slice->len, 0, sizeof(void*)*count);
+  slice->len += count;
+}
+
 void *slice_get(slice_t *slice, size_t idx) {
   if(slice->cap == 0 || slice->data == NULL)
     return NULL;
@@ -135,11 +1027,9 @@ void *slice_get(slice_t *slice, size_t idx) {
 }
 
 void slice_set(slice_t *slice, size_t idx, void *value) {
-  if(idx >= slice->cap)
-    _slice_maybe_grow(slice, idx - slice->cap);
   if(idx >= slice->len) {
-    for(size_t i = slice->len; i < idx; i++)
-      slice->data[i] = NULL;
+    _slice_maybe_grow(slice, idx + 1 - slice->len);
+    memset(slice->data + slice->len, 0, sizeof(void*)*(idx - slice->len));
     slice->len = idx+1;
   }
   slice->data[idx] = value;
@@ -159,17 +1049,769 @@ void slice_reduce(slice_t *slice, void *acc, slice_reduce_cb_t cb) {
 
 void slice_shrink(slice_t *slice, size_t overhead) {
   slice->cap = slice->len + overhead;
-  slice->data = (void **)QML_REALLOC(slice->data, sizeof(void*)*slice->cap);
+  _slice_realloc(slice);
 }
 
 void slice_free(slice_t *slice) {
+  // an aligned slice shrunk to nothing still has memory to release
+  if(slice->data == NULL)
+    return;
+
+  slice->len = 0;
+  slice->cap = 0;
+  _slice_release(slice->data, slice->align);
+  slice->data = NULL;
+}
+
+// Inserting and removing
+
+int slice_insert(slice_t *slice, size_t idx, void *value) {
+  return slice_insert_n(slice, idx, &value, 1);
+}
+
+int slice_insert_n(slice_t *slice, size_t idx, void **values, size_t count) {
+  if(idx > slice->len)
+    return 0;
+  _slice_maybe_grow(slice, count);
+  memmove(slice->data + idx + count, slice->data + idx,
+          sizeof(void*)*(slice->len - idx));
+  memcpy(slice->data + idx, values, sizeof(void*)*count);
+  slice->len += count;
+  return 1;
+}
+
+void *slice_remove(slice_t *slice, size_t idx) {
+  if(idx >= slice->len)
+    return NULL;
+  void *value = slice->data[idx];
+  slice_remove_range(slice, idx, 1);
+  return value;
+}
+
+size_t slice_remove_range(slice_t *slice, size_t idx, size_t count) {
+  if(idx >= slice->len)
+    return 0;
+  if(count > slice->len - idx)
+    count = slice->len - idx;
+  memmove(slice->data + idx, slice->data + idx + count,
+          sizeof(void*)*(slice->len - idx - count));
+  slice->len -= count;
+  return count;
+}
+
+void *slice_swap_remove(slice_t *slice, size_t idx) {
+  if(idx >= slice->len)
+    return NULL;
+  void *value = slice->data[idx];
+  slice->data[idx] = slice->data[--slice->len];
+  return value;
+}
+
+size_t slice_retain(slice_t *slice, slice_iter_cb_t pred) {
+  size_t out = 0;
+  for(size_t i = 0; i < slice->len; i++) {
+    void *value = slice->data[i];
+    slice->data[out] = value;
+    out += pred(i, value) != 0;
+  }
+  slice->len = out;
+  return out;
+}
+
+// Mapping and filtering
+
+void slice_map(slice_t *out, slice_t *in, slice_map_cb_t map) {
+  _slice_maybe_grow(out, in->len);
+  void **dst = out->data + out->len;
+  for(size_t i = 0; i < in->len; i++)
+    dst[i] = map(i, in->data[i]);
+  out->len += in->len;
+}
+
+void slice_filter(slice_t *out, slice_t *in, slice_iter_cb_t pred) {
+  _slice_maybe_grow(out, in->len);
+  void **dst = out->data + out->len;
+  size_t kept = 0;
+  for(size_t i = 0; i < in->len; i++) {
+    void *value = in->data[i];
+    dst[kept] = value;
+    kept += pred(i, value) != 0;
+  }
+  out->len += kept;
+}
+
+void slice_filter_map(slice_t *out, slice_t *in, slice_filter_map_cb_t cb) {
+  _slice_maybe_grow(out, in->len);
+  void **dst = out->data + out->len;
+  size_t kept = 0;
+  for(size_t i = 0; i < in->len; i++)
+    kept += cb(i, in->data[i], &dst[kept]) != 0;
+  out->len += kept;
+}
+
+void slice_map_in_place(slice_t *slice, slice_map_cb_t map) {
+  for(size_t i = 0; i < slice->len; i++)
+    slice->data[i] = map(i, slice->data[i]);
+}
+
+size_t slice_filter_map_in_place(slice_t *slice, slice_filter_map_cb_t cb) {
+  size_t kept = 0;
+  for(size_t i = 0; i < slice->len; i++) {
+    // read the value first, cb may overwrite it when kept == i
+    void *value = slice->data[i];
+    kept += cb(i, value, &slice->data[kept]) != 0;
+  }
+  slice->len = kept;
+  return kept;
+}
+
+// Value slices
+
+val_slice_t slice_alloc_val(size_t elem_size, size_t cap) {
+  return slice_alloc_val_aligned(elem_size, cap, 0);
+}
+
+val_slice_t slice_alloc_val_aligned(size_t elem_size, size_t cap,
+                                    size_t align) {
+  if(cap == 0)
+    cap = 1;
+  char *data = align == 0
+    ? (char *)_SLICE_ALLOC(elem_size*cap)
+    : (char *)_slice_aligned_alloc(elem_size*cap, align);
+  return (val_slice_t){ 0, cap, data, elem_size, align };
+}
+
+void _slice_val_maybe_grow(val_slice_t *slice, size_t amt) {
+  #ifdef QML_SLICE_ALLOW_AUTO_ALLOC
+    if(slice->data == NULL) {
+      *slice = slice_alloc_val_aligned(slice->elem_size, amt, slice->align);
+    }
+  #endif
+
+  if(slice->len + amt >= slice->cap) {
+    slice->cap += slice->cap/2 + amt;
+    slice->data = (char *)_slice_resize(slice->data,
+                                        slice->elem_size*slice->len,
+                                        slice->elem_size*slice->cap,
+                                        slice->align);
+  }
+}
+
+void slice_append_val(val_slice_t *slice, const void *value) {
+  _slice_val_maybe_grow(slice, 1);
+  memcpy(slice->data + slice->elem_size*slice->len, value, slice->elem_size);
+  slice->len++;
+}
+
+void *slice_get_ptr(val_slice_t *slice, size_t idx) {
   if(slice->cap == 0 || slice->data == NULL)
+    return NULL;
+  if(idx >= slice->len)
+    return NULL;
+  return slice->data + slice->elem_size*idx;
+}
+
+void slice_set_val(val_slice_t *slice, size_t idx, const void *value) {
+  if(idx >= slice->len) {
+    _slice_val_maybe_grow(slice, idx+1 - slice->len);
+    memset(slice->data + slice->elem_size*slice->len, 0,
+           slice->elem_size*(idx - slice->len));
+    slice->len = idx+1;
+  }
+  memcpy(slice->data + slice->elem_size*idx, value, slice->elem_size);
+}
+
+void slice_iter_val(val_slice_t *slice, slice_iter_cb_t cb) {
+  char *elem = slice->data;
+  for(size_t i = 0; i < slice->len; i++, elem += slice->elem_size)
+    if(!cb(i, elem))
+      break;
+}
+
+void slice_reduce_val(val_slice_t *slice, void *acc, slice_reduce_cb_t cb) {
+  char *elem = slice->data;
+  for(size_t i = 0; i < slice->len; i++, elem += slice->elem_size)
+    if(!cb(acc, i, elem))
+      break;
+}
+
+void slice_shrink_val(val_slice_t *slice, size_t overhead) {
+  slice->cap = slice->len + overhead;
+  slice->data = (char *)_slice_resize(slice->data,
+                                      slice->elem_size*slice->len,
+                                      slice->elem_size*slice->cap,
+                                      slice->align);
+}
+
+void slice_free_val(val_slice_t *slice) {
+  if(slice->data == NULL)
     return;
 
   slice->len = 0;
   slice->cap = 0;
-  QML_FREE(slice->data);
+  _slice_release(slice->data, slice->align);
   slice->data = NULL;
 }
 
+// Deques
+
+slice_deque_t slice_deque_alloc(size_t cap) {
+  size_t pow2 = 1;
+  while(pow2 < cap)
+    pow2 <<= 1;
+  void **data = (void**)_SLICE_ALLOC(sizeof(void*)*pow2);
+  return (slice_deque_t){ 0, 0, pow2, data };
+}
+
+// Doubles the deque's capacity. The values that wrapped around the end of the
+// old ring are moved right after it, so the ring stays in one piece.
+static void _slice_deque_grow(slice_deque_t *deque) {
+  #ifdef QML_SLICE_ALLOW_AUTO_ALLOC
+    if(deque->cap == 0 || deque->data == NULL) {
+      *deque = slice_deque_alloc(1);
+      return;
+    }
+  #endif
+
+  size_t cap = deque->cap;
+  deque->data = (void**)_SLICE_REALLOC(deque->data, sizeof(void*)*cap*2);
+  size_t end = deque->head + deque->len;
+  if(end > cap)
+    memcpy(deque->data + cap, deque->data, sizeof(void*)*(end - cap));
+  deque->cap = cap*2;
+}
+
+void slice_push_front(slice_deque_t *deque, void *value) {
+  if(deque->len == deque->cap)
+    _slice_deque_grow(deque);
+  deque->head = (deque->head - 1) & (deque->cap - 1);
+  deque->data[deque->head] = value;
+  deque->len++;
+}
+
+void slice_push_back(slice_deque_t *deque, void *value) {
+  if(deque->len == deque->cap)
+    _slice_deque_grow(deque);
+  deque->data[(deque->head + deque->len) & (deque->cap - 1)] = value;
+  deque->len++;
+}
+
+void *slice_pop_front(slice_deque_t *deque) {
+  if(deque->len == 0)
+    return NULL;
+  void *value = deque->data[deque->head];
+  deque->head = (deque->head + 1) & (deque->cap - 1);
+  deque->len--;
+  return value;
+}
+
+void *slice_pop_back(slice_deque_t *deque) {
+  if(deque->len == 0)
+    return NULL;
+  deque->len--;
+  return deque->data[(deque->head + deque->len) & (deque->cap - 1)];
+}
+
+void *slice_deque_get(slice_deque_t *deque, size_t idx) {
+  if(idx >= deque->len)
+    return NULL;
+  return deque->data[(deque->head + idx) & (deque->cap - 1)];
+}
+
+void slice_deque_iter(slice_deque_t *deque, slice_iter_cb_t cb) {
+  // the values run from head to the end of the ring, then from it's start
+  size_t first = deque->cap - deque->head;
+  if(first > deque->len)
+    first = deque->len;
+  for(size_t i = 0; i < first; i++)
+    if(!cb(i, deque->data[deque->head + i]))
+      return;
+  for(size_t i = first; i < deque->len; i++)
+    if(!cb(i, deque->data[i - first]))
+      return;
+}
+
+void slice_deque_reduce(slice_deque_t *deque, void *acc, slice_reduce_cb_t cb) {
+  size_t first = deque->cap - deque->head;
+  if(first > deque->len)
+    first = deque->len;
+  for(size_t i = 0; i < first; i++)
+    if(!cb(acc, i, deque->data[deque->head + i]))
+      return;
+  for(size_t i = first; i < deque->len; i++)
+    if(!cb(acc, i, deque->data[i - first]))
+      return;
+}
+
+void slice_deque_free(slice_deque_t *deque) {
+  if(deque->cap == 0 || deque->data == NULL)
+    return;
+
+  _SLICE_FREE(deque->data);
+  deque->head = 0;
+  deque->len = 0;
+  deque->cap = 0;
+  deque->data = NULL;
+}
+
+// Segmented slices
+
+// Index of the highest set bit of v, which must not be 0.
+static inline unsigned _slice_log2(size_t v) {
+  #if defined(__GNUC__) || defined(__clang__)
+    return (unsigned)(sizeof(unsigned long long)*8 - 1 -
+                      __builtin_clzll((unsigned long long)v));
+  #else
+    unsigned log = 0;
+    while(v >>= 1)
+      log++;
+    return log;
+  #endif
+}
+
+// Splits an index into the block holding it and the offset within that block.
+// Block k starts at index QML_SLICE_SEG_FIRST * (2^k - 1).
+static inline void _slice_seg_locate(size_t idx, size_t *block,
+                                     size_t *offset) {
+  size_t v = idx + QML_SLICE_SEG_FIRST;
+  unsigned log = _slice_log2(v);
+  *block = log - QML_SLICE_SEG_FIRST_SHIFT;
+  *offset = v ^ ((size_t)1 << log);
+}
+
+void slice_seg_append(slice_seg_t *seg, void *value) {
+  size_t block, offset;
+  _slice_seg_locate(seg->len, &block, &offset);
+  if(seg->len == seg->cap) {
+    size_t size = QML_SLICE_SEG_FIRST << block;
+    seg->blocks[block] = (void**)_SLICE_ALLOC(sizeof(void*)*size);
+    seg->cap += size;
+  }
+  seg->blocks[block][offset] = value;
+  seg->len++;
+}
+
+void *slice_seg_get(slice_seg_t *seg, size_t idx) {
+  if(idx >= seg->len)
+    return NULL;
+  size_t block, offset;
+  _slice_seg_locate(idx, &block, &offset);
+  return seg->blocks[block][offset];
+}
+
+void **slice_seg_at(slice_seg_t *seg, size_t idx) {
+  if(idx >= seg->len)
+    return NULL;
+  size_t block, offset;
+  _slice_seg_locate(idx, &block, &offset);
+  return &seg->blocks[block][offset];
+}
+
+void slice_seg_iter(slice_seg_t *seg, slice_iter_cb_t cb) {
+  size_t idx = 0;
+  for(size_t block = 0; idx < seg->len; block++) {
+    size_t size = QML_SLICE_SEG_FIRST << block;
+    void **data = seg->blocks[block];
+    for(size_t i = 0; i < size && idx < seg->len; i++, idx++)
+      if(!cb(idx, data[i]))
+        return;
+  }
+}
+
+void slice_seg_reduce(slice_seg_t *seg, void *acc, slice_reduce_cb_t cb) {
+  size_t idx = 0;
+  for(size_t block = 0; idx < seg->len; block++) {
+    size_t size = QML_SLICE_SEG_FIRST << block;
+    void **data = seg->blocks[block];
+    for(size_t i = 0; i < size && idx < seg->len; i++, idx++)
+      if(!cb(acc, idx, data[i]))
+        return;
+  }
+}
+
+void slice_seg_free(slice_seg_t *seg) {
+  size_t size = 0;
+  for(size_t block = 0; size < seg->cap; block++) {
+    size += QML_SLICE_SEG_FIRST << block;
+    _SLICE_FREE(seg->blocks[block]);
+    seg->blocks[block] = NULL;
+  }
+  seg->len = 0;
+  seg->cap = 0;
+}
+
+// Object pools
+
+// Every block starts with a header holding the previous block, padded so the
+// objects after it stay aligned.
+#define _SLICE_POOL_HEADER (2*sizeof(void*))
+
+slice_pool_t slice_pool_alloc(size_t obj_size, size_t block_cap) {
+  // objects have to fit the free list link and be aligned like a pointer
+  if(obj_size < sizeof(void*))
+    obj_size = sizeof(void*);
+  obj_size = (obj_size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+  if(block_cap == 0)
+    block_cap = 1;
+  return (slice_pool_t){ obj_size, block_cap, block_cap, NULL, NULL };
+}
+
+void *slice_pool_obj(slice_pool_t *pool) {
+  if(pool->free_list != NULL) {
+    void *obj = pool->free_list;
+    pool->free_list = *(void **)obj;
+    return obj;
+  }
+
+  if(pool->used == pool->block_cap) {
+    char *block = (char *)_SLICE_ALLOC(_SLICE_POOL_HEADER +
+                                       pool->obj_size*pool->block_cap);
+    if(block == NULL)
+      return NULL;
+    *(char **)block = pool->block;
+    pool->block = block;
+    pool->used = 0;
+  }
+  return pool->block + _SLICE_POOL_HEADER + pool->obj_size*pool->used++;
+}
+
+void slice_pool_release(slice_pool_t *pool, void *obj) {
+  *(void **)obj = pool->free_list;
+  pool->free_list = obj;
+}
+
+void slice_pool_free(slice_pool_t *pool) {
+  char *block = pool->block;
+  while(block != NULL) {
+    char *prev = *(char **)block;
+    _SLICE_FREE(block);
+    block = prev;
+  }
+  pool->block = NULL;
+  pool->free_list = NULL;
+  pool->used = pool->block_cap;
+}
+
+void slice_free_with_pool(slice_t *slice, slice_pool_t *pool) {
+  slice_free(slice);
+  slice_pool_free(pool);
+}
+
+// Sparse slices
+
+void *slice_sparse_get(slice_sparse_t *sparse, size_t idx) {
+  size_t page = idx >> QML_SLICE_SPARSE_PAGE_SHIFT;
+  if(idx >= sparse->len || page >= sparse->pages.len)
+    return NULL;
+  void **data = (void**)sparse->pages.data[page];
+  if(data == NULL)
+    return NULL;
+  return data[idx & (QML_SLICE_SPARSE_PAGE - 1)];
+}
+
+void slice_sparse_set(slice_sparse_t *sparse, size_t idx, void *value) {
+  size_t page = idx >> QML_SLICE_SPARSE_PAGE_SHIFT;
+  if(idx >= sparse->len)
+    sparse->len = idx+1;
+
+  void **data = NULL;
+  if(page < sparse->pages.len)
+    data = (void**)sparse->pages.data[page];
+  if(data == NULL) {
+    // unallocated pages already read as NULL
+    if(value == NULL)
+      return;
+    data = (void**)_SLICE_ALLOC(sizeof(void*)*QML_SLICE_SPARSE_PAGE);
+    memset(data, 0, sizeof(void*)*QML_SLICE_SPARSE_PAGE);
+    slice_set(&sparse->pages, page, data);
+  }
+  data[idx & (QML_SLICE_SPARSE_PAGE - 1)] = value;
+}
+
+void slice_sparse_iter(slice_sparse_t *sparse, slice_iter_cb_t cb) {
+  for(size_t page = 0; page < sparse->pages.len; page++) {
+    void **data = (void**)sparse->pages.data[page];
+    if(data == NULL)
+      continue;
+    size_t base = page << QML_SLICE_SPARSE_PAGE_SHIFT;
+    for(size_t i = 0; i < QML_SLICE_SPARSE_PAGE; i++)
+      if(data[i] != NULL && !cb(base + i, data[i]))
+        return;
+  }
+}
+
+void slice_sparse_reduce(slice_sparse_t *sparse, void *acc,
+                         slice_reduce_cb_t cb) {
+  for(size_t page = 0; page < sparse->pages.len; page++) {
+    void **data = (void**)sparse->pages.data[page];
+    if(data == NULL)
+      continue;
+    size_t base = page << QML_SLICE_SPARSE_PAGE_SHIFT;
+    for(size_t i = 0; i < QML_SLICE_SPARSE_PAGE; i++)
+      if(data[i] != NULL && !cb(acc, base + i, data[i]))
+        return;
+  }
+}
+
+void slice_sparse_free(slice_sparse_t *sparse) {
+  for(size_t page = 0; page < sparse->pages.len; page++)
+    if(sparse->pages.data[page] != NULL)
+      _SLICE_FREE(sparse->pages.data[page]);
+  slice_free(&sparse->pages);
+  sparse->len = 0;
+}
+
+// Sorting
+
+// slice_sort goes through the same introsort as SLICE_DEFINE_SORT, calling the
+// comparator through a pointer.
+typedef struct _slice_cmp_ctx {
+  slice_cmp_cb_t *cmp;
+} _slice_cmp_ctx_t;
+
+#define _SLICE_CMP_LESS(a, b, ctx) \
+  (((_slice_cmp_ctx_t *)(ctx))->cmp((a), (b)) < 0)
+SLICE_DEFINE_SORT(_slice_sort_ptrs, void *, _SLICE_CMP_LESS)
+
+void slice_sort(slice_t *slice, slice_cmp_cb_t cmp) {
+  _slice_cmp_ctx_t ctx = { cmp };
+  _slice_sort_ptrs(slice->data, slice->len, &ctx);
+}
+
+typedef struct _slice_keyed {
+  uint64_t key;
+  void    *value;
+} _slice_keyed_t;
+
+int slice_sort_radix(slice_t *slice, slice_key_cb_t key) {
+  size_t len = slice->len;
+  if(len < 2)
+    return 1;
+  size_t keyed_size = sizeof(_slice_keyed_t)*len;
+  _slice_keyed_t *src = (_slice_keyed_t *)_SLICE_ALLOC(keyed_size);
+  _slice_keyed_t *dst = (_slice_keyed_t *)_SLICE_ALLOC(keyed_size);
+  size_t (*counts)[256] = (size_t (*)[256])_SLICE_ALLOC(sizeof(size_t)*256*8);
+  if(src == NULL || dst == NULL || counts == NULL) {
+    _SLICE_FREE(src);
+    _SLICE_FREE(dst);
+    _SLICE_FREE(counts);
+    return 0;
+  }
+
+  // extract every key once and count all 8 digits in a single pass
+  memset(counts, 0, sizeof(size_t)*256*8);
+  for(size_t i = 0; i < len; i++) {
+    uint64_t k = key(slice->data[i]);
+    src[i].key = k;
+    src[i].value = slice->data[i];
+    for(int d = 0; d < 8; d++)
+      counts[d][(k >> (8*d)) & 0xff]++;
+  }
+
+  for(int d = 0; d < 8; d++) {
+    size_t *count = counts[d];
+    // every key has the same digit here, nothing would move
+    if(count[src[0].key >> (8*d) & 0xff] == len)
+      continue;
+
+    size_t offset = 0;
+    for(int b = 0; b < 256; b++) {
+      size_t c = count[b];
+      count[b] = offset;
+      offset += c;
+    }
+    for(size_t i = 0; i < len; i++)
+      dst[count[(src[i].key >> (8*d)) & 0xff]++] = src[i];
+
+    _slice_keyed_t *tmp = src;
+    src = dst;
+    dst = tmp;
+  }
+
+  for(size_t i = 0; i < len; i++)
+    slice->data[i] = src[i].value;
+  _SLICE_FREE(src);
+  _SLICE_FREE(dst);
+  _SLICE_FREE(counts);
+  return 1;
+}
+
+// Searching and set operations
+
+#ifdef __GNUC__
+#define _slice_prefetch(addr) __builtin_prefetch(addr)
+#else
+#define _slice_prefetch(addr) ((void)(addr))
+#endif
+
+size_t slice_lower_bound(slice_t *slice, void *value, slice_cmp_cb_t cmp) {
+  if(slice->len == 0)
+    return 0;
+  void **base = slice->data;
+  size_t len = slice->len;
+  while(len > 1) {
+    size_t half = len/2;
+    // both places the next step could look at
+    _slice_prefetch(base + half/2);
+    _slice_prefetch(base + half + half/2);
+    base = cmp(base[half], value) < 0 ? base + half : base;
+    len -= half;
+  }
+  return (base - slice->data) + (cmp(*base, value) < 0);
+}
+
+size_t slice_upper_bound(slice_t *slice, void *value, slice_cmp_cb_t cmp) {
+  if(slice->len == 0)
+    return 0;
+  void **base = slice->data;
+  size_t len = slice->len;
+  while(len > 1) {
+    size_t half = len/2;
+    _slice_prefetch(base + half/2);
+    _slice_prefetch(base + half + half/2);
+    base = cmp(base[half], value) <= 0 ? base + half : base;
+    len -= half;
+  }
+  return (base - slice->data) + (cmp(*base, value) <= 0);
+}
+
+size_t slice_unique(slice_t *slice, slice_cmp_cb_t cmp) {
+  if(slice->len < 2)
+    return slice->len;
+  size_t out = 1;
+  for(size_t i = 1; i < slice->len; i++)
+    if(cmp(slice->data[out-1], slice->data[i]) != 0)
+      slice->data[out++] = slice->data[i];
+  slice->len = out;
+  return out;
+}
+
+void slice_merge(slice_t *out, slice_t *a, slice_t *b, slice_cmp_cb_t cmp) {
+  _slice_maybe_grow(out, a->len + b->len);
+  size_t i = 0, j = 0;
+  void **dst = out->data + out->len;
+  while(i < a->len && j < b->len) {
+    if(cmp(b->data[j], a->data[i]) < 0)
+      *dst++ = b->data[j++];
+    else
+      *dst++ = a->data[i++];
+  }
+  memcpy(dst, a->data + i, sizeof(void*)*(a->len - i));
+  dst += a->len - i;
+  memcpy(dst, b->data + j, sizeof(void*)*(b->len - j));
+  out->len += a->len + b->len;
+}
+
+void slice_intersect(slice_t *out, slice_t *a, slice_t *b, slice_cmp_cb_t cmp) {
+  _slice_maybe_grow(out, a->len < b->len ? a->len : b->len);
+  size_t i = 0, j = 0;
+  while(i < a->len && j < b->len) {
+    int c = cmp(a->data[i], b->data[j]);
+    if(c < 0) {
+      i++;
+    } else if(c > 0) {
+      j++;
+    } else {
+      out->data[out->len++] = a->data[i++];
+      j++;
+    }
+  }
+}
+
+void slice_difference(slice_t *out, slice_t *a, slice_t *b,
+                      slice_cmp_cb_t cmp) {
+  _slice_maybe_grow(out, a->len);
+  size_t i = 0, j = 0;
+  while(i < a->len) {
+    int c = j < b->len ? cmp(a->data[i], b->data[j]) : -1;
+    if(c < 0) {
+      out->data[out->len++] = a->data[i++];
+    } else if(c > 0) {
+      j++;
+    } else {
+      i++;
+      j++;
+    }
+  }
+}
+
+// Fills the subtree rooted at k with the sorted values starting at i, in
+// order. Returns the index of the first value that was not used.
+static size_t _slice_eytz_fill(void **out, void **sorted, size_t i, size_t k,
+                               size_t len) {
+  if(k > len)
+    return i;
+  i = _slice_eytz_fill(out, sorted, i, 2*k, len);
+  out[k] = sorted[i++];
+  return _slice_eytz_fill(out, sorted, i, 2*k+1, len);
+}
+
+slice_eytz_t slice_eytz_build(slice_t *sorted) {
+  // the layout is 1-indexed, data[0] is unused
+  slice_eytz_t eytz = {
+    sorted->len, (void **)_SLICE_ALLOC(sizeof(void*)*(sorted->len+1))
+  };
+  eytz.data[0] = NULL;
+  _slice_eytz_fill(eytz.data, sorted->data, 0, 1, sorted->len);
+  return eytz;
+}
+
+void *slice_eytz_lower_bound(slice_eytz_t *eytz, void *value,
+                             slice_cmp_cb_t cmp) {
+  size_t k = 1;
+  while(k <= eytz->len) {
+    // the descendants 4 levels down share a couple of cache lines
+    _slice_prefetch(eytz->data + 16*k);
+    k = 2*k + (cmp(eytz->data[k], value) < 0);
+  }
+  // undo the right turns taken after the last left turn, which is where the
+  // answer was found
+  while(k & 1)
+    k >>= 1;
+  k >>= 1;
+  return k == 0 ? NULL : eytz->data[k];
+}
+
+void slice_eytz_free(slice_eytz_t *eytz) {
+  if(eytz->data == NULL)
+    return;
+  _SLICE_FREE(eytz->data);
+  eytz->data = NULL;
+  eytz->len = 0;
+}
+
+// Heaps
+
+// The slice_heap_ functions share the comparator adapter of slice_sort.
+SLICE_DEFINE_HEAP(_slice_heap_ptrs, void *, _SLICE_CMP_LESS,
+                  QML_SLICE_HEAP_ARITY)
+
+void slice_heapify(slice_t *slice, slice_cmp_cb_t cmp) {
+  _slice_cmp_ctx_t ctx = { cmp };
+  _slice_heap_ptrs_heapify(slice->data, slice->len, &ctx);
+}
+
+void slice_heap_push(slice_t *slice, void *value, slice_cmp_cb_t cmp) {
+  _slice_cmp_ctx_t ctx = { cmp };
+  slice_append(slice, value);
+  _slice_heap_ptrs_push(slice->data, slice->len, &ctx);
+}
+
+void *slice_heap_pop(slice_t *slice, slice_cmp_cb_t cmp) {
+  if(slice->len == 0)
+    return NULL;
+  _slice_cmp_ctx_t ctx = { cmp };
+  _slice_heap_ptrs_pop(slice->data, slice->len, &ctx);
+  return slice->data[--slice->len];
+}
+
+void slice_heap_decrease(slice_t *slice, size_t idx, void *value,
+                         slice_cmp_cb_t cmp) {
+  if(idx >= slice->len)
+    return;
+  _slice_cmp_ctx_t ctx = { cmp };
+  slice->data[idx] = value;
+  _slice_heap_ptrs_sift_up(slice->data, idx, &ctx);
+}
+
 #endif
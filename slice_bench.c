@@ -0,0 +1,83 @@
+#define _GNU_SOURCE
+#include "slice.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#define ELEMS 10000000
+#define RUNS 5
+
+SLICE_DEFINE(long)
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *name, double best, long sum) {
+  printf("%-28s %7.2f ms  %5.2f ns per element  (sum %ld)\n", name,
+         best * 1e3, best * 1e9 / ELEMS, sum);
+}
+
+int sum_reduce_cb(void *acc, size_t idx, void *val) {
+  (void)idx;
+  *(long *)acc += (long)(intptr_t)val;
+  return 1;
+}
+
+int sum_val_reduce_cb(void *acc, size_t idx, void *val) {
+  (void)idx;
+  *(long *)acc += *(long *)val;
+  return 1;
+}
+
+// Sums 10M elements with the callback functions, the inline functions and the
+// iteration macros, keeping the best of a few runs of each.
+int main(void) {
+  slice_t ptrs = slice_alloc(ELEMS);
+  val_slice_t vals = slice_alloc_val(sizeof(long), ELEMS);
+  slice_long_t typed = slice_long_alloc(ELEMS);
+  for(long i = 0; i < ELEMS; i++) {
+    slice_append(&ptrs, (void *)(intptr_t)i);
+    slice_append_val(&vals, &i);
+    slice_long_append(&typed, i);
+  }
+  // called from any other file, slice_reduce can't see which callback it gets,
+  // reading them through volatile pointers keeps that true here as well
+  slice_reduce_cb_t *volatile reduce_cb = sum_reduce_cb;
+  slice_reduce_cb_t *volatile val_reduce_cb = sum_val_reduce_cb;
+  const long want = (long)ELEMS * (ELEMS - 1) / 2;
+  int wrong = 0;
+  long sum;
+  double best, start;
+
+  #define BENCH(name, body)                                                    \
+    best = 1e9;                                                                \
+    for(int run = 0; run < RUNS; run++) {                                      \
+      sum = 0;                                                                 \
+      start = now();                                                           \
+      body;                                                                    \
+      double took = now() - start;                                             \
+      if(took < best)                                                          \
+        best = took;                                                           \
+    }                                                                          \
+    report(name, best, sum);                                                   \
+    wrong += sum != want;
+
+  BENCH("slice_reduce", slice_reduce(&ptrs, &sum, reduce_cb));
+  BENCH("slice_reduce_inline", slice_reduce_inline(&ptrs, &sum,
+                                                   sum_reduce_cb));
+  BENCH("SLICE_FOREACH", SLICE_FOREACH(&ptrs, i, val)
+                           sum += (long)(intptr_t)val);
+  BENCH("slice_reduce_val", slice_reduce_val(&vals, &sum, val_reduce_cb));
+  BENCH("SLICE_FOREACH_VAL", SLICE_FOREACH_VAL(&vals, i, long, val)
+                               sum += *val);
+  BENCH("SLICE_FOREACH_TYPED", SLICE_FOREACH_TYPED(&typed, i, long, val)
+                                 sum += *val);
+
+  slice_free(&ptrs);
+  slice_free_val(&vals);
+  slice_long_free(&typed);
+  return wrong != 0;
+}
@@ -0,0 +1,408 @@
+/*
+slice_concurrent.h
+------------------
+Defines the public API for slices that can be shared between threads without
+a lock, and an optional implementation. Every function has a comment
+describing it.
+
+This header builds on slice.h and relies on the GCC/Clang __atomic builtins.
+
+To include the implementation with this header file, define
+QML_SLICE_CONCURRENT_IMPLEMENTATION beforehand:
+
+  #define QML_SLICE_CONCURRENT_IMPLEMENTATION
+  #include "slice_concurrent.h"
+
+Basic usage:
+
+  // a zeroed concurrent slice is valid and empty
+  slice_conc_t results = {0};
+
+  // on any number of threads at once, each append takes a single atomic
+  // increment to claim an index
+  size_t idx = slice_conc_append(&results, my_result);
+
+  // on any thread, every index below the watermark has been written and can
+  // be read
+  size_t ready = slice_conc_published(&results);
+  for(size_t i = 0; i < ready; i++)
+    consume(slice_conc_get(&results, i));
+
+  // once no thread uses it anymore
+  slice_conc_free(&results);
+
+Shared slices:
+
+  // a single writer appends to a contiguous slice while readers use it, old
+  // arrays are only freed once no reader can still be looking at them
+  slice_shared_t table = slice_shared_alloc(64);
+  int reader = slice_shared_register(&table);  // once per reader thread
+
+  // on the writer thread
+  slice_shared_append(&table, my_value);
+
+  // on a reader thread
+  slice_shared_enter(&table, reader);
+  void *value = slice_shared_get(&table, 3);
+  slice_shared_leave(&table, reader);
+
+Customising behavior:
+
+  // The most reader threads a shared slice can have registered. Defaults to
+  // 64.
+  #define QML_SLICE_SHARED_MAX_READERS 256
+
+*/
+
+#ifndef QML_SLICE_CONCURRENT_DEFINED
+#define QML_SLICE_CONCURRENT_DEFINED
+
+#include "slice.h"
+
+// A slice any number of threads can append to at once. The values are stored
+// in blocks laid out like those of slice_seg_t, which never move once they are
+// allocated, so appending never has to wait for other threads to stop reading.
+typedef struct slice_conc {
+  // Number of indices claimed by appending threads so far.
+  size_t   len;
+  char     _pad0[QML_ALIGN_CACHE_LINE];
+  // Every index below this has been written. Only ever grows.
+  size_t   published;
+  char     _pad1[QML_ALIGN_CACHE_LINE];
+  // Every block holds it's pointers followed by a flag for each of them, set
+  // once the pointer has been written.
+    void **blocks[QML_SLICE_SEG_BLOCKS];
+} slice_conc_t;
+
+// Append a pointer to the end of the slice and return it's index. Safe to call
+// from any number of threads at once. Only the first thread to find a block
+// missing allocates it, others needing the same block wait for it. Returns
+// SIZE_MAX if the block could not be allocated, the watermark can't move past
+// the lost index after that.
+size_t slice_conc_append(slice_conc_t *conc, void *value);
+// Get the number of values from the start of the slice that have all been
+// written, and may be read from any thread. Every value appended by a thread
+// before this call is below it once all appends running at the same time have
+// finished.
+size_t slice_conc_published(slice_conc_t *conc);
+// Tries to get the value at the given index, this will return NULL if the index
+// is out of bounds or the value has not been written yet.
+void *slice_conc_get(slice_conc_t *conc, size_t idx);
+// Same as slice_iter, visiting the values below slice_conc_published.
+void slice_conc_iter(slice_conc_t *conc, slice_iter_cb_t cb);
+// Frees every block of the slice and sets it as empty. No other thread may use
+// the slice while it is freed.
+void slice_conc_free(slice_conc_t *conc);
+
+// Shared slices
+//
+// A shared slice is a contiguous slice written by one thread at a time and read
+// by any number of others without a lock. Growing it publishes a new array,
+// and the old one is retired through epoch-based reclamation: readers announce
+// the epoch they entered in, and arrays retired in an epoch are only freed
+// once every reader has moved past it. The writer never waits for readers.
+
+#ifndef QML_SLICE_SHARED_MAX_READERS
+#define QML_SLICE_SHARED_MAX_READERS 64
+#endif
+
+typedef struct _slice_shared_array {
+  size_t   cap;
+    void  *data[];
+} _slice_shared_array_t;
+
+typedef struct _slice_shared_reader {
+  // The epoch the reader entered in, shifted left by one with the lowest bit
+  // set, or 0 if it is not reading.
+  unsigned long epoch;
+  char          _pad[QML_ALIGN_CACHE_LINE - sizeof(unsigned long)];
+} _slice_shared_reader_t;
+
+typedef struct slice_shared {
+  _slice_shared_array_t *array;
+  size_t                 len;
+  unsigned long          epoch;
+  unsigned               readers_used;
+  // Arrays retired in each of the last three epochs, by epoch modulo 3.
+  slice_t                retired[3];
+  _slice_shared_reader_t readers[QML_SLICE_SHARED_MAX_READERS];
+} slice_shared_t;
+
+// Allocate a shared slice with length 0 and the given capacity.
+slice_shared_t slice_shared_alloc(size_t cap);
+// Register a reader thread and return it's index, which is passed to
+// slice_shared_enter and slice_shared_leave. Returns -1 if
+// QML_SLICE_SHARED_MAX_READERS readers are registered already.
+int slice_shared_register(slice_shared_t *shared);
+// Start reading the slice on the given reader. Arrays the reader sees are kept
+// alive until it calls slice_shared_leave.
+void slice_shared_enter(slice_shared_t *shared, int reader);
+// Stop reading the slice on the given reader. Values taken from the slice stay
+// valid, but the slice may not be read again until the next
+// slice_shared_enter.
+void slice_shared_leave(slice_shared_t *shared, int reader);
+// Tries to get the value at the given index, this will return NULL if the index
+// is out of bounds. Has to be called between slice_shared_enter and
+// slice_shared_leave.
+void *slice_shared_get(slice_shared_t *shared, size_t idx);
+// Same as slice_iter, visiting the values that were appended before the call.
+// Has to be called between slice_shared_enter and slice_shared_leave.
+void slice_shared_iter(slice_shared_t *shared, slice_iter_cb_t cb);
+// Append a pointer to the end of the slice, publishing a larger array if
+// necessary. Only one thread may write to the slice at a time.
+void slice_shared_append(slice_shared_t *shared, void *value);
+// Free the arrays no reader can see anymore. This happens on its own whenever
+// the slice grows, so it is only needed to release memory sooner. Only one
+// thread may write to the slice at a time.
+void slice_shared_collect(slice_shared_t *shared);
+// Frees the slice and every retired array. No other thread may use the slice
+// while it is freed.
+void slice_shared_free(slice_shared_t *shared);
+
+#endif // QML_SLICE_CONCURRENT_DEFINED
+
+#ifdef QML_SLICE_CONCURRENT_IMPLEMENTATION
+
+#include <string.h>
+
+#ifndef QML_ALLOC
+#include <stdlib.h>
+#define QML_ALLOC malloc
+#endif
+
+#ifndef QML_FREE
+#include <stdlib.h>
+#define QML_FREE free
+#endif
+
+// Concurrent append
+
+// The written flags come right after a block's size pointers.
+static inline char *_slice_conc_flags(void **block, size_t block_idx) {
+  return (char *)(block + (QML_SLICE_SEG_FIRST << block_idx));
+}
+
+// Stands in for a block while one thread allocates it, so that the other
+// threads needing it wait instead of allocating a copy of their own.
+static char _slice_conc_pending;
+#define _SLICE_CONC_PENDING ((void **)&_slice_conc_pending)
+
+// Returns the given block if it has been allocated, or NULL.
+static inline void **_slice_conc_load(slice_conc_t *conc, size_t block_idx) {
+  void **block = __atomic_load_n(&conc->blocks[block_idx], __ATOMIC_ACQUIRE);
+  return block == _SLICE_CONC_PENDING ? NULL : block;
+}
+
+// Returns the given block, allocating it if no thread has done so yet, or NULL
+// if it could not be allocated.
+static void **_slice_conc_block(slice_conc_t *conc, size_t block_idx) {
+  void **block = __atomic_load_n(&conc->blocks[block_idx], __ATOMIC_ACQUIRE);
+  for(;;) {
+    if(block != NULL && block != _SLICE_CONC_PENDING)
+      return block;
+    // whoever swaps the missing block for the placeholder allocates it
+    if(block == NULL
+       && __atomic_compare_exchange_n(&conc->blocks[block_idx], &block,
+                                      _SLICE_CONC_PENDING, 0,
+                                      __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+      break;
+    if(block == _SLICE_CONC_PENDING)
+      block = __atomic_load_n(&conc->blocks[block_idx], __ATOMIC_ACQUIRE);
+  }
+
+  size_t size = QML_SLICE_SEG_FIRST << block_idx;
+  void **fresh = (void**)QML_ALLOC((sizeof(void*) + 1)*size);
+  // on failure the block is missing again, for the next thread to retry
+  if(fresh != NULL)
+    memset(_slice_conc_flags(fresh, block_idx), 0, size);
+  __atomic_store_n(&conc->blocks[block_idx], fresh, __ATOMIC_RELEASE);
+  return fresh;
+}
+
+size_t slice_conc_append(slice_conc_t *conc, void *value) {
+  size_t idx = __atomic_fetch_add(&conc->len, 1, __ATOMIC_RELAXED);
+  size_t block_idx, offset;
+  _slice_seg_locate(idx, &block_idx, &offset);
+  void **block = _slice_conc_block(conc, block_idx);
+  if(block == NULL)
+    return SIZE_MAX;
+  block[offset] = value;
+  __atomic_store_n(&_slice_conc_flags(block, block_idx)[offset], 1,
+                   __ATOMIC_RELEASE);
+  return idx;
+}
+
+// Returns 1 if the value at the given index has been written. The index has to
+// have been claimed by an appending thread already.
+static int _slice_conc_written(slice_conc_t *conc, size_t idx) {
+  size_t block_idx, offset;
+  _slice_seg_locate(idx, &block_idx, &offset);
+  void **block = _slice_conc_load(conc, block_idx);
+  if(block == NULL)
+    return 0;
+  return __atomic_load_n(&_slice_conc_flags(block, block_idx)[offset],
+                         __ATOMIC_ACQUIRE);
+}
+
+size_t slice_conc_published(slice_conc_t *conc) {
+  size_t published = __atomic_load_n(&conc->published, __ATOMIC_ACQUIRE);
+  size_t len = __atomic_load_n(&conc->len, __ATOMIC_RELAXED);
+  size_t mark = published;
+  while(mark < len && _slice_conc_written(conc, mark))
+    mark++;
+
+  // move the watermark forward, unless another thread already moved it further
+  while(mark > published)
+    if(__atomic_compare_exchange_n(&conc->published, &published, mark, 1,
+                                   __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+      return mark;
+  return published;
+}
+
+void *slice_conc_get(slice_conc_t *conc, size_t idx) {
+  if(idx >= __atomic_load_n(&conc->len, __ATOMIC_RELAXED))
+    return NULL;
+  size_t block_idx, offset;
+  _slice_seg_locate(idx, &block_idx, &offset);
+  void **block = _slice_conc_load(conc, block_idx);
+  if(block == NULL)
+    return NULL;
+  if(!__atomic_load_n(&_slice_conc_flags(block, block_idx)[offset],
+                      __ATOMIC_ACQUIRE))
+    return NULL;
+  return block[offset];
+}
+
+void slice_conc_iter(slice_conc_t *conc, slice_iter_cb_t cb) {
+  size_t len = slice_conc_published(conc);
+  size_t idx = 0;
+  for(size_t block_idx = 0; idx < len; block_idx++) {
+    size_t size = QML_SLICE_SEG_FIRST << block_idx;
+    void **block = __atomic_load_n(&conc->blocks[block_idx], __ATOMIC_ACQUIRE);
+    for(size_t i = 0; i < size && idx < len; i++, idx++)
+      if(!cb(idx, block[i]))
+        return;
+  }
+}
+
+void slice_conc_free(slice_conc_t *conc) {
+  for(size_t i = 0; i < QML_SLICE_SEG_BLOCKS; i++) {
+    if(conc->blocks[i] != NULL)
+      QML_FREE(conc->blocks[i]);
+    conc->blocks[i] = NULL;
+  }
+  conc->len = 0;
+  conc->published = 0;
+}
+
+// Shared slices
+
+static _slice_shared_array_t *_slice_shared_array(size_t cap) {
+  _slice_shared_array_t *array = (_slice_shared_array_t *)QML_ALLOC(
+    sizeof(_slice_shared_array_t) + sizeof(void*)*cap);
+  array->cap = cap;
+  return array;
+}
+
+slice_shared_t slice_shared_alloc(size_t cap) {
+  slice_shared_t shared;
+  memset(&shared, 0, sizeof(shared));
+  shared.array = _slice_shared_array(cap == 0 ? 1 : cap);
+  return shared;
+}
+
+int slice_shared_register(slice_shared_t *shared) {
+  unsigned reader = __atomic_fetch_add(&shared->readers_used, 1,
+                                       __ATOMIC_RELAXED);
+  if(reader >= QML_SLICE_SHARED_MAX_READERS)
+    return -1;
+  return (int)reader;
+}
+
+void slice_shared_enter(slice_shared_t *shared, int reader) {
+  unsigned long epoch = __atomic_load_n(&shared->epoch, __ATOMIC_ACQUIRE);
+  __atomic_store_n(&shared->readers[reader].epoch, epoch << 1 | 1,
+                   __ATOMIC_RELAXED);
+  // the announcement has to be visible before any array is read
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void slice_shared_leave(slice_shared_t *shared, int reader) {
+  __atomic_store_n(&shared->readers[reader].epoch, 0, __ATOMIC_RELEASE);
+}
+
+void *slice_shared_get(slice_shared_t *shared, size_t idx) {
+  // the array is published before the length that needs it
+  size_t len = __atomic_load_n(&shared->len, __ATOMIC_ACQUIRE);
+  if(idx >= len)
+    return NULL;
+  _slice_shared_array_t *array = __atomic_load_n(&shared->array,
+                                                 __ATOMIC_ACQUIRE);
+  return array->data[idx];
+}
+
+void slice_shared_iter(slice_shared_t *shared, slice_iter_cb_t cb) {
+  size_t len = __atomic_load_n(&shared->len, __ATOMIC_ACQUIRE);
+  _slice_shared_array_t *array = __atomic_load_n(&shared->array,
+                                                 __ATOMIC_ACQUIRE);
+  for(size_t i = 0; i < len; i++)
+    if(!cb(i, array->data[i]))
+      break;
+}
+
+// Frees every array in the given list of retired arrays.
+static void _slice_shared_free_retired(slice_t *retired) {
+  for(size_t i = 0; i < retired->len; i++)
+    QML_FREE(retired->data[i]);
+  retired->len = 0;
+}
+
+void slice_shared_collect(slice_shared_t *shared) {
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  unsigned long epoch = __atomic_load_n(&shared->epoch, __ATOMIC_RELAXED);
+  unsigned readers = __atomic_load_n(&shared->readers_used, __ATOMIC_RELAXED);
+  if(readers > QML_SLICE_SHARED_MAX_READERS)
+    readers = QML_SLICE_SHARED_MAX_READERS;
+
+  // the epoch can only move on once every active reader has entered in it
+  for(unsigned i = 0; i < readers; i++) {
+    unsigned long seen = __atomic_load_n(&shared->readers[i].epoch,
+                                         __ATOMIC_ACQUIRE);
+    if(seen != 0 && seen != (epoch << 1 | 1))
+      return;
+  }
+
+  // readers may still be in the previous epoch, but none in the one before
+  // it, which shares it's list with the next epoch
+  __atomic_store_n(&shared->epoch, epoch+1, __ATOMIC_RELEASE);
+  _slice_shared_free_retired(&shared->retired[(epoch+1) % 3]);
+}
+
+void slice_shared_append(slice_shared_t *shared, void *value) {
+  _slice_shared_array_t *array = shared->array;
+  size_t len = shared->len;
+  if(len == array->cap) {
+    _slice_shared_array_t *grown = _slice_shared_array(array->cap*2);
+    memcpy(grown->data, array->data, sizeof(void*)*len);
+    __atomic_store_n(&shared->array, grown, __ATOMIC_RELEASE);
+
+    unsigned long epoch = __atomic_load_n(&shared->epoch, __ATOMIC_RELAXED);
+    slice_append(&shared->retired[epoch % 3], array);
+    slice_shared_collect(shared);
+    array = grown;
+  }
+  array->data[len] = value;
+  __atomic_store_n(&shared->len, len+1, __ATOMIC_RELEASE);
+}
+
+void slice_shared_free(slice_shared_t *shared) {
+  for(int i = 0; i < 3; i++) {
+    _slice_shared_free_retired(&shared->retired[i]);
+    slice_free(&shared->retired[i]);
+  }
+  QML_FREE(shared->array);
+  shared->array = NULL;
+  shared->len = 0;
+}
+
+#endif // QML_SLICE_CONCURRENT_IMPLEMENTATION
@@ -0,0 +1,122 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+
+// counts allocations, so that racing producers can be checked to allocate
+// every block only once
+long allocs = 0;
+int fail_allocs = 0;
+
+void *counting_alloc(size_t size) {
+  __atomic_fetch_add(&allocs, 1, __ATOMIC_RELAXED);
+  return fail_allocs ? NULL : malloc(size);
+}
+
+#define QML_ALLOC counting_alloc
+#define QML_SLICE_CONCURRENT_IMPLEMENTATION
+#include "slice_concurrent.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define THREADS 4
+#define PER_THREAD 250000
+
+slice_conc_t results = {0};
+long sum = 0;
+
+// appends the integers 1-250000, 250001-500000 and so on, never 0 since that
+// would read as NULL
+void *producer_main(void *arg) {
+  intptr_t first = (intptr_t)arg * PER_THREAD + 1;
+  for(intptr_t i = 0; i < PER_THREAD; i++)
+    slice_conc_append(&results, (void *)(first + i));
+  return NULL;
+}
+
+slice_shared_t table;
+int writer_done = 0;
+
+// reads the shared slice while it is being appended to, checking that every
+// value is where it should be
+void *reader_main(void *arg) {
+  (void)arg;
+  int reader = slice_shared_register(&table);
+  long wrong = 0;
+  while(!__atomic_load_n(&writer_done, __ATOMIC_ACQUIRE)) {
+    slice_shared_enter(&table, reader);
+    for(size_t i = 0; i < 1000; i++) {
+      void *val = slice_shared_get(&table, i * 997);
+      wrong += val != NULL && (size_t)(intptr_t)val != i * 997 + 1;
+    }
+    slice_shared_leave(&table, reader);
+  }
+  return (void *)(intptr_t)wrong;
+}
+
+int sum_iter_cb(size_t idx, void *val) {
+  (void)idx;
+  sum += (long)(intptr_t)val;
+  return 1;
+}
+
+int main(void) {
+  pthread_t producers[THREADS];
+  for(intptr_t i = 0; i < THREADS; i++)
+    pthread_create(&producers[i], NULL, producer_main, (void *)i);
+
+  // read along while the producers are still appending, every value below the
+  // watermark has to be there already
+  size_t seen = 0, missing = 0;
+  while(seen < THREADS*PER_THREAD) {
+    size_t mark = slice_conc_published(&results);
+    for(size_t i = seen; i < mark; i++)
+      missing += slice_conc_get(&results, i) == NULL;
+    seen = mark;
+  }
+
+  for(int i = 0; i < THREADS; i++)
+    pthread_join(producers[i], NULL);
+  slice_conc_iter(&results, sum_iter_cb);
+  printf("Sum of integers 1-%d is %ld.\n", THREADS*PER_THREAD, sum);
+  printf("Values missing below the watermark: %zu\n", missing);
+  long blocks = 0;
+  for(size_t i = 0; i < QML_SLICE_SEG_BLOCKS; i++)
+    blocks += results.blocks[i] != NULL;
+  printf("Allocated %ld times for %ld blocks.\n", allocs, blocks);
+  int conc_sum_ok = sum == 500000500000L && allocs == blocks;
+
+  // a block that can't be allocated is reported, and tried again next time
+  slice_conc_t failing = {0};
+  fail_allocs = 1;
+  int failed = slice_conc_append(&failing, (void *)1) == SIZE_MAX;
+  fail_allocs = 0;
+  int retried = slice_conc_append(&failing, (void *)2) == 1
+    && slice_conc_get(&failing, 1) == (void *)2;
+  printf("Failed allocation reported and retried: %s\n",
+         failed && retried ? "yes" : "no");
+  conc_sum_ok = conc_sum_ok && failed && retried;
+  slice_conc_free(&failing);
+  slice_conc_free(&results);
+
+  // a single writer growing a shared slice while readers keep reading it
+  table = slice_shared_alloc(1);
+  pthread_t readers[THREADS];
+  for(int i = 0; i < THREADS; i++)
+    pthread_create(&readers[i], NULL, reader_main, NULL);
+  for(intptr_t i = 0; i < THREADS*PER_THREAD; i++)
+    slice_shared_append(&table, (void *)(i + 1));
+  __atomic_store_n(&writer_done, 1, __ATOMIC_RELEASE);
+  long wrong = 0;
+  for(int i = 0; i < THREADS; i++) {
+    void *res;
+    pthread_join(readers[i], &res);
+    wrong += (long)(intptr_t)res;
+  }
+  sum = 0;
+  slice_shared_iter(&table, sum_iter_cb);
+  printf("Sum of shared integers 1-%d is %ld.\n", THREADS*PER_THREAD, sum);
+  printf("Wrong values read while growing: %ld\n", wrong);
+  slice_shared_free(&table);
+
+  return !conc_sum_ok || sum != 500000500000L || missing != 0 || wrong != 0;
+}
@@ -0,0 +1,247 @@
+/*
+slice_file.h
+------------
+Defines the public API for value slices stored in a memory-mapped file, and an
+optional implementation. Every function has a comment describing it.
+
+The file starts with a small header recording the element size and the
+slice's length, followed by the elements themselves. Opening an existing file
+only maps it, so a slice that took a long time to build is available again
+right away.
+
+This header builds on slice.h and requires POSIX. Compile with _DEFAULT_SOURCE
+(or _XOPEN_SOURCE 500) defined, a strict C99 build does not declare ftruncate
+otherwise. With _GNU_SOURCE instead, the file is remapped in place on Linux as
+it grows.
+
+To include the implementation with this header file, define
+QML_SLICE_FILE_IMPLEMENTATION beforehand:
+
+  #define QML_SLICE_FILE_IMPLEMENTATION
+  #include "slice_file.h"
+
+Basic usage:
+
+  // open the file, creating it with room for 100 integers if it's missing
+  slice_file_t my_ints;
+  if(!slice_file_open(&my_ints, "ints.bin", sizeof(int), 100))
+    return 1;
+  for(int i = 0; i < 100; i++)
+    slice_file_append(&my_ints, &i);
+  // make sure everything so far is on disk, without closing the file
+  slice_file_checkpoint(&my_ints);
+  // closing checkpoints as well
+  slice_file_close(&my_ints);
+
+  // later, possibly in another process, the integers are all still there
+  slice_file_open(&my_ints, "ints.bin", sizeof(int), 0);
+  int *third = slice_file_get(&my_ints, 2);
+
+Customising behavior:
+
+  // The file is grown by at least this many bytes at a time. Defaults to
+  // 64KiB.
+  #define QML_SLICE_FILE_MIN_GROWTH (1024*1024)
+
+*/
+
+#ifndef QML_SLICE_FILE_DEFINED
+#define QML_SLICE_FILE_DEFINED
+
+#include "slice.h"
+
+// Version of the file layout, stored in every file's header.
+#define QML_SLICE_FILE_VERSION 1
+// Size of the header in bytes. It's part of the file layout, so unlike the
+// alignments in slice.h it can't be changed.
+#define QML_SLICE_FILE_HEADER_SIZE 64
+
+// The header at the start of every file. The elements start right after it.
+typedef struct slice_file_header {
+  char     magic[8];
+  uint32_t version, _reserved;
+  uint64_t elem_size, len;
+  char     _pad[QML_SLICE_FILE_HEADER_SIZE - 32];
+} slice_file_header_t;
+
+// A value slice stored in a memory-mapped file. Elements are laid out like in
+// val_slice_t, and pointers to them are invalidated when the slice grows.
+typedef struct slice_file {
+  size_t   len, cap;
+    char  *data;
+  size_t   elem_size;
+  // The whole mapped file, header included.
+  slice_file_header_t *header;
+  size_t   map_size;
+     int   fd;
+} slice_file_t;
+
+// Open the file at the given path as a value slice of elem_size byte
+// elements. If the file does not exist it is created with room for cap
+// elements. Returns 0 if the file could not be opened or mapped, or if it is
+// not a slice file with the same element size and version.
+int slice_file_open(slice_file_t *file, const char *path, size_t elem_size,
+                    size_t cap);
+// Copy elem_size bytes from value to the end of the slice, growing the file if
+// necessary. Returns 0 if the file could not be grown.
+int slice_file_append(slice_file_t *file, const void *value);
+// Grow the file, if necessary, so that at least amt more elements can be
+// appended without it growing again. Returns 0 if the file could not be grown.
+int slice_file_reserve(slice_file_t *file, size_t amt);
+// Get a pointer to the element at the given index, or NULL if the index is out
+// of bounds. The pointer is invalidated when the slice grows.
+void *slice_file_get(slice_file_t *file, size_t idx);
+// Record the slice's length in the header and write every change to disk,
+// returning once it is there. Returns 0 if writing failed.
+int slice_file_checkpoint(slice_file_t *file);
+// Checkpoint the slice like slice_file_checkpoint, then unmap and close the
+// file. Returns 0 if writing failed, the file is closed either way.
+int slice_file_close(slice_file_t *file);
+
+#endif // QML_SLICE_FILE_DEFINED
+
+#ifdef QML_SLICE_FILE_IMPLEMENTATION
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__GLIBC__) && !defined(_POSIX_C_SOURCE)
+#error "slice_file.h needs _DEFAULT_SOURCE or _XOPEN_SOURCE defined"
+#endif
+
+#ifndef QML_SLICE_FILE_MIN_GROWTH
+#define QML_SLICE_FILE_MIN_GROWTH (64*1024)
+#endif
+
+static const char _slice_file_magic[8] = { 'Q','M','L','S','L','I','C','E' };
+
+// Points the slice's fields into a freshly mapped file.
+static void _slice_file_attach(slice_file_t *file, void *map, size_t size) {
+  file->header = (slice_file_header_t *)map;
+  file->map_size = size;
+  file->data = (char *)map + sizeof(slice_file_header_t);
+  file->cap = (size - sizeof(slice_file_header_t)) / file->elem_size;
+}
+
+int slice_file_open(slice_file_t *file, const char *path, size_t elem_size,
+                    size_t cap) {
+  if(elem_size == 0)
+    return 0;
+  int fd = open(path, O_RDWR | O_CREAT, 0644);
+  if(fd < 0)
+    return 0;
+
+  struct stat st;
+  if(fstat(fd, &st) != 0)
+    goto fail;
+  size_t size = (size_t)st.st_size;
+  int fresh = size == 0;
+  if(fresh) {
+    if(cap == 0)
+      cap = 1;
+    size = sizeof(slice_file_header_t) + elem_size*cap;
+    if(ftruncate(fd, (off_t)size) != 0)
+      goto fail;
+  } else if(size < sizeof(slice_file_header_t)) {
+    goto fail;
+  }
+
+  void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if(map == MAP_FAILED)
+    goto fail;
+  slice_file_header_t *header = (slice_file_header_t *)map;
+
+  if(fresh) {
+    memcpy(header->magic, _slice_file_magic, sizeof(_slice_file_magic));
+    header->version = QML_SLICE_FILE_VERSION;
+    header->elem_size = elem_size;
+    header->len = 0;
+  } else if(memcmp(header->magic, _slice_file_magic, 8) != 0
+            || header->version != QML_SLICE_FILE_VERSION
+            || header->elem_size != elem_size
+            || sizeof(slice_file_header_t) + header->len*elem_size > size) {
+    munmap(map, size);
+    goto fail;
+  }
+
+  file->fd = fd;
+  file->elem_size = elem_size;
+  file->len = (size_t)header->len;
+  _slice_file_attach(file, map, size);
+  return 1;
+
+fail:
+  close(fd);
+  return 0;
+}
+
+int slice_file_reserve(slice_file_t *file, size_t amt) {
+  if(file->len + amt <= file->cap)
+    return 1;
+
+  size_t cap = file->cap + file->cap/2 + amt;
+  size_t size = sizeof(slice_file_header_t) + file->elem_size*cap;
+  if(size - file->map_size < QML_SLICE_FILE_MIN_GROWTH)
+    size = file->map_size + QML_SLICE_FILE_MIN_GROWTH;
+  if(ftruncate(file->fd, (off_t)size) != 0)
+    return 0;
+
+  // either way the old mapping stays valid if the new one can't be made
+  #if defined(__linux__) && defined(MREMAP_MAYMOVE)
+    void *map = mremap(file->header, file->map_size, size, MREMAP_MAYMOVE);
+    if(map == MAP_FAILED)
+      return 0;
+  #else
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, file->fd,
+                     0);
+    if(map == MAP_FAILED)
+      return 0;
+    munmap(file->header, file->map_size);
+  #endif
+  _slice_file_attach(file, map, size);
+  return 1;
+}
+
+int slice_file_append(slice_file_t *file, const void *value) {
+  if(!slice_file_reserve(file, 1))
+    return 0;
+  memcpy(file->data + file->elem_size*file->len, value, file->elem_size);
+  file->len++;
+  return 1;
+}
+
+void *slice_file_get(slice_file_t *file, size_t idx) {
+  if(file->data == NULL || idx >= file->len)
+    return NULL;
+  return file->data + file->elem_size*idx;
+}
+
+int slice_file_checkpoint(slice_file_t *file) {
+  // the elements have to be on disk before the length that covers them
+  if(msync(file->header, file->map_size, MS_SYNC) != 0)
+    return 0;
+  file->header->len = file->len;
+  return msync(file->header, sizeof(slice_file_header_t), MS_SYNC) == 0;
+}
+
+int slice_file_close(slice_file_t *file) {
+  if(file->header == NULL)
+    return 1;
+  // a length stored without syncing first could cover elements that never
+  // made it to disk
+  int ok = slice_file_checkpoint(file);
+  munmap(file->header, file->map_size);
+  close(file->fd);
+  file->header = NULL;
+  file->data = NULL;
+  file->len = 0;
+  file->cap = 0;
+  file->map_size = 0;
+  file->fd = -1;
+  return ok;
+}
+
+#endif // QML_SLICE_FILE_IMPLEMENTATION
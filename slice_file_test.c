@@ -0,0 +1,57 @@
+#define _GNU_SOURCE
+#define QML_SLICE_FILE_IMPLEMENTATION
+#include "slice_file.h"
+#include <stdio.h>
+#include <unistd.h>
+
+int sum_ints(slice_file_t *file) {
+  int sum = 0;
+  for(size_t i = 0; i < file->len; i++)
+    sum += *(int *)slice_file_get(file, i);
+  return sum;
+}
+
+int main(void) {
+  const char *path = "slice_file_test.bin";
+  unlink(path);
+
+  // create the file with room for 10 integers, so it has to grow
+  slice_file_t my_ints;
+  if(!slice_file_open(&my_ints, path, sizeof(int), 10))
+    return 1;
+  for(int i = 0; i < 50; i++)
+    slice_file_append(&my_ints, &i);
+  if(!slice_file_checkpoint(&my_ints))
+    return 1;
+  // the rest is only written to disk by closing
+  for(int i = 50; i < 100; i++)
+    slice_file_append(&my_ints, &i);
+  printf("Sum of integers 0-99 is %d.\n", sum_ints(&my_ints));
+  if(!slice_file_close(&my_ints))
+    return 1;
+
+  // open it again, the integers are read straight from the file
+  if(!slice_file_open(&my_ints, path, sizeof(int), 0))
+    return 1;
+  int sum = sum_ints(&my_ints);
+  printf("Sum of integers 0-99 after reopening is %d.\n", sum);
+  slice_file_close(&my_ints);
+
+  // the elements start at a fixed offset, whatever QML_ALIGN_CACHE_LINE is
+  int seventh = -1;
+  FILE *raw = fopen(path, "rb");
+  if(raw == NULL || fseek(raw, QML_SLICE_FILE_HEADER_SIZE + 7*sizeof(int),
+                          SEEK_SET) != 0
+     || fread(&seventh, sizeof(int), 1, raw) != 1)
+    return 1;
+  fclose(raw);
+  printf("Integer 7 read from the file directly is %d.\n", seventh);
+
+  // a different element size is refused
+  slice_file_t wrong;
+  int refused = !slice_file_open(&wrong, path, sizeof(double), 0);
+  printf("Refused a different element size: %s\n", refused ? "yes" : "no");
+
+  unlink(path);
+  return sum != 4950 || seventh != 7 || !refused;
+}
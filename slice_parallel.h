@@ -0,0 +1,542 @@
+/*
+slice_parallel.h
+----------------
+Defines the public API for processing slices on multiple threads, and an
+optional implementation. Every function has a comment describing it.
+
+This header builds on slice.h and requires POSIX threads. Compile with
+_GNU_SOURCE (or _DEFAULT_SOURCE) defined and link with -pthread.
+
+To include the implementation with this header file, define
+QML_SLICE_PARALLEL_IMPLEMENTATION beforehand:
+
+  #define QML_SLICE_PARALLEL_IMPLEMENTATION
+  #include "slice_parallel.h"
+
+Basic usage:
+
+  // start a set of worker threads, one per CPU, to be reused for every call
+  slice_workers_t *workers = slice_workers_new(0);
+  long sum = 0, zero = 0;
+  // every chunk of the slice is reduced into it's own copy of zero, and the
+  // chunk results are then combined into sum, in order
+  slice_reduce_parallel(workers, &my_slice, &sum, &zero, sizeof(long),
+                        sum_reduce_cb, sum_combine_cb);
+  slice_workers_free(workers);
+
+  void sum_combine_cb(void *acc, void *part) {
+    *(long *)acc += *(long *)part;
+  }
+
+  // call process_cb on every element, with threads stealing work from each
+  // other whenever they run out
+  slice_parallel_for(workers, &my_slice, 0, process_cb, my_ctx);
+
+Customising behavior:
+
+  // Slices are never split into chunks smaller than this many elements.
+  // Defaults to 4096.
+  #define QML_SLICE_PARALLEL_MIN_CHUNK 16384
+
+  // Slices shorter than this are sorted on the calling thread alone by
+  // slice_sort_parallel. Defaults to 65536.
+  #define QML_SLICE_PARALLEL_SORT_THRESHOLD 100000
+
+*/
+
+#ifndef QML_SLICE_PARALLEL_DEFINED
+#define QML_SLICE_PARALLEL_DEFINED
+
+#include "slice.h"
+
+// Merges the accumulator of a single chunk into the final accumulator.
+typedef void(slice_combine_cb_t)(void *acc, void *part);
+
+typedef struct slice_workers slice_workers_t;
+
+// Start a set of count threads to process slices with, including the calling
+// thread. If count is 0, one thread per online CPU is used. Returns NULL if the
+// threads could not be started.
+slice_workers_t *slice_workers_new(unsigned count);
+// Stop the worker threads and free them.
+void slice_workers_free(slice_workers_t *workers);
+// Reduce the slice in parallel. The slice is split into chunks, each of which
+// is reduced with cb into it's own accumulator of acc_size bytes, starting out
+// as a copy of identity. The chunk accumulators are then merged into acc with
+// combine, in the order of the chunks. If cb returns 0, only the rest of it's
+// chunk is skipped. Returns once the whole reduction is done.
+void slice_reduce_parallel(slice_workers_t *workers, slice_t *slice, void *acc,
+                           const void *identity, size_t acc_size,
+                           slice_reduce_cb_t cb, slice_combine_cb_t combine);
+// Call cb on every element of the slice in parallel, with ctx as it's first
+// argument. The work is split into ranges of at most grain elements, which
+// idle threads steal from busy ones, so elements that take uneven amounts of
+// time to process still keep every thread busy. A grain of 0 picks one based
+// on the slice's length. If cb returns 0, no new elements will be processed,
+// though calls already running on other threads finish. Returns 1 if every
+// element was processed and 0 if the loop was stopped early.
+int slice_parallel_for(slice_workers_t *workers, slice_t *slice, size_t grain,
+                       slice_reduce_cb_t cb, void *ctx);
+// Sort the slice like slice_sort, using every thread. Each thread sorts a part
+// of the slice, after which the sorted parts are merged pairwise in parallel.
+// Slices shorter than QML_SLICE_PARALLEL_SORT_THRESHOLD are sorted with
+// slice_sort directly.
+void slice_sort_parallel(slice_workers_t *workers, slice_t *slice,
+                         slice_cmp_cb_t cmp);
+
+#endif // QML_SLICE_PARALLEL_DEFINED
+
+#ifdef QML_SLICE_PARALLEL_IMPLEMENTATION
+
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifndef QML_ALLOC
+#include <stdlib.h>
+#define QML_ALLOC malloc
+#endif
+
+#ifndef QML_FREE
+#include <stdlib.h>
+#define QML_FREE free
+#endif
+
+#ifndef QML_SLICE_PARALLEL_MIN_CHUNK
+#define QML_SLICE_PARALLEL_MIN_CHUNK 4096
+#endif
+
+#ifndef QML_SLICE_PARALLEL_SORT_THRESHOLD
+#define QML_SLICE_PARALLEL_SORT_THRESHOLD 65536
+#endif
+
+// Called once on every thread, including the calling one, for each job.
+typedef void(_slice_job_fn_t)(slice_workers_t *workers, unsigned idx,
+                              void *job);
+
+// Capacity of every worker's deque. Ranges are split in half before being
+// pushed, so a deque never holds more than log2(len) of them at once.
+#define _QML_SLICE_DEQUE_CAP 128
+
+typedef struct _slice_worker {
+  slice_workers_t *workers;
+  unsigned         idx;
+  pthread_t        thread;
+
+  // work-stealing deque of index ranges, bottom and the ranges are used by the
+  // owning worker, top mostly by thieves
+  long             bottom;
+  size_t           tasks[_QML_SLICE_DEQUE_CAP][2];
+  char             _pad0[QML_ALIGN_CACHE_LINE];
+  long             top;
+  // keep workers from sharing cache lines
+  char             _pad1[QML_ALIGN_CACHE_LINE];
+} _slice_worker_t;
+
+struct slice_workers {
+  unsigned         count;
+  _slice_worker_t *threads;
+
+  pthread_mutex_t  lock;
+  pthread_cond_t   start, done;
+  unsigned long    generation;
+  unsigned         finished;
+  int              stop;
+  _slice_job_fn_t *fn;
+  void            *job;
+};
+
+static void *_slice_worker_main(void *arg) {
+  _slice_worker_t *self = (_slice_worker_t *)arg;
+  slice_workers_t *w = self->workers;
+  unsigned long seen = 0;
+
+  pthread_mutex_lock(&w->lock);
+  for(;;) {
+    while(w->generation == seen && !w->stop)
+      pthread_cond_wait(&w->start, &w->lock);
+    if(w->stop)
+      break;
+    seen = w->generation;
+    _slice_job_fn_t *fn = w->fn;
+    void *job = w->job;
+    pthread_mutex_unlock(&w->lock);
+
+    fn(w, self->idx, job);
+
+    pthread_mutex_lock(&w->lock);
+    if(++w->finished == w->count-1)
+      pthread_cond_signal(&w->done);
+  }
+  pthread_mutex_unlock(&w->lock);
+  return NULL;
+}
+
+// Runs fn on every worker thread and the calling thread, returning once all of
+// them are done.
+static void _slice_workers_run(slice_workers_t *w, _slice_job_fn_t fn,
+                               void *job) {
+  pthread_mutex_lock(&w->lock);
+  w->fn = fn;
+  w->job = job;
+  w->finished = 0;
+  w->generation++;
+  pthread_cond_broadcast(&w->start);
+  pthread_mutex_unlock(&w->lock);
+
+  fn(w, 0, job);
+
+  pthread_mutex_lock(&w->lock);
+  while(w->finished < w->count-1)
+    pthread_cond_wait(&w->done, &w->lock);
+  pthread_mutex_unlock(&w->lock);
+}
+
+slice_workers_t *slice_workers_new(unsigned count) {
+  if(count == 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    count = cpus > 0 ? (unsigned)cpus : 1;
+  }
+
+  slice_workers_t *w = (slice_workers_t *)QML_ALLOC(sizeof(slice_workers_t));
+  if(w == NULL)
+    return NULL;
+  memset(w, 0, sizeof(*w));
+  w->count = count;
+  w->threads = (_slice_worker_t *)QML_ALLOC(sizeof(_slice_worker_t)*count);
+  if(w->threads == NULL) {
+    QML_FREE(w);
+    return NULL;
+  }
+  memset(w->threads, 0, sizeof(_slice_worker_t)*count);
+  pthread_mutex_init(&w->lock, NULL);
+  pthread_cond_init(&w->start, NULL);
+  pthread_cond_init(&w->done, NULL);
+
+  // the calling thread acts as worker 0
+  w->threads[0].workers = w;
+  for(unsigned i = 1; i < count; i++) {
+    w->threads[i].workers = w;
+    w->threads[i].idx = i;
+    if(pthread_create(&w->threads[i].thread, NULL, _slice_worker_main,
+                      &w->threads[i]) != 0) {
+      w->count = i;
+      slice_workers_free(w);
+      return NULL;
+    }
+  }
+  return w;
+}
+
+void slice_workers_free(slice_workers_t *w) {
+  pthread_mutex_lock(&w->lock);
+  w->stop = 1;
+  pthread_cond_broadcast(&w->start);
+  pthread_mutex_unlock(&w->lock);
+  for(unsigned i = 1; i < w->count; i++)
+    pthread_join(w->threads[i].thread, NULL);
+
+  pthread_cond_destroy(&w->done);
+  pthread_cond_destroy(&w->start);
+  pthread_mutex_destroy(&w->lock);
+  QML_FREE(w->threads);
+  QML_FREE(w);
+}
+
+// Parallel reduction
+
+typedef struct _slice_reduce_job {
+  slice_t           *slice;
+  slice_reduce_cb_t *cb;
+  char              *accs;
+  size_t             acc_size, chunks;
+  size_t             next_chunk;
+} _slice_reduce_job_t;
+
+static void _slice_reduce_chunk(_slice_reduce_job_t *job, size_t chunk) {
+  size_t len = job->slice->len;
+  size_t begin = len*chunk / job->chunks, end = len*(chunk+1) / job->chunks;
+  void *acc = job->accs + job->acc_size*chunk;
+  for(size_t i = begin; i < end; i++)
+    if(!job->cb(acc, i, job->slice->data[i]))
+      break;
+}
+
+static void _slice_reduce_worker(slice_workers_t *w, unsigned idx, void *arg) {
+  (void)w;
+  (void)idx;
+  _slice_reduce_job_t *job = (_slice_reduce_job_t *)arg;
+  // chunks are handed out one at a time, so faster threads take more of them
+  for(;;) {
+    size_t chunk = __atomic_fetch_add(&job->next_chunk, 1, __ATOMIC_RELAXED);
+    if(chunk >= job->chunks)
+      break;
+    _slice_reduce_chunk(job, chunk);
+  }
+}
+
+void slice_reduce_parallel(slice_workers_t *w, slice_t *slice, void *acc,
+                           const void *identity, size_t acc_size,
+                           slice_reduce_cb_t cb, slice_combine_cb_t combine) {
+  // a few chunks per thread balances uneven chunks without making the
+  // combining step noticeable
+  size_t chunks = slice->len / QML_SLICE_PARALLEL_MIN_CHUNK;
+  if(chunks > (size_t)w->count*4)
+    chunks = (size_t)w->count*4;
+  if(chunks <= 1 || w->count == 1) {
+    slice_reduce(slice, acc, cb);
+    return;
+  }
+
+  _slice_reduce_job_t job = { slice, cb, NULL, acc_size, chunks, 0 };
+  job.accs = (char *)QML_ALLOC(acc_size*chunks);
+  if(job.accs == NULL) {
+    slice_reduce(slice, acc, cb);
+    return;
+  }
+  for(size_t i = 0; i < chunks; i++)
+    memcpy(job.accs + acc_size*i, identity, acc_size);
+
+  _slice_workers_run(w, _slice_reduce_worker, &job);
+
+  for(size_t i = 0; i < chunks; i++)
+    combine(acc, job.accs + acc_size*i);
+  QML_FREE(job.accs);
+}
+
+// Work-stealing parallel for
+//
+// Every worker owns a Chase-Lev deque of index ranges. A worker splits the
+// range it is working on in half until it is no larger than the grain, pushing
+// the upper halves onto the bottom of it's deque, and pops them back when it is
+// done with the lower half. Idle workers steal from the top of other workers'
+// deques, which holds the largest ranges.
+
+static int _slice_deque_push(_slice_worker_t *self, size_t begin, size_t end) {
+  long b = __atomic_load_n(&self->bottom, __ATOMIC_RELAXED);
+  long t = __atomic_load_n(&self->top, __ATOMIC_ACQUIRE);
+  if(b - t >= _QML_SLICE_DEQUE_CAP)
+    return 0;
+  size_t *slot = self->tasks[b & (_QML_SLICE_DEQUE_CAP-1)];
+  __atomic_store_n(&slot[0], begin, __ATOMIC_RELAXED);
+  __atomic_store_n(&slot[1], end, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  __atomic_store_n(&self->bottom, b+1, __ATOMIC_RELAXED);
+  return 1;
+}
+
+static int _slice_deque_pop(_slice_worker_t *self, size_t *begin,
+                            size_t *end) {
+  long b = __atomic_load_n(&self->bottom, __ATOMIC_RELAXED) - 1;
+  __atomic_store_n(&self->bottom, b, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  long t = __atomic_load_n(&self->top, __ATOMIC_RELAXED);
+  if(t > b) {
+    __atomic_store_n(&self->bottom, b+1, __ATOMIC_RELAXED);
+    return 0;
+  }
+
+  size_t *slot = self->tasks[b & (_QML_SLICE_DEQUE_CAP-1)];
+  *begin = __atomic_load_n(&slot[0], __ATOMIC_RELAXED);
+  *end = __atomic_load_n(&slot[1], __ATOMIC_RELAXED);
+  if(t < b)
+    return 1;
+
+  // last range left, race the thieves for it
+  int won = __atomic_compare_exchange_n(&self->top, &t, t+1, 0,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+  __atomic_store_n(&self->bottom, b+1, __ATOMIC_RELAXED);
+  return won;
+}
+
+static int _slice_deque_steal(_slice_worker_t *victim, size_t *begin,
+                              size_t *end) {
+  long t = __atomic_load_n(&victim->top, __ATOMIC_ACQUIRE);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  long b = __atomic_load_n(&victim->bottom, __ATOMIC_ACQUIRE);
+  if(t >= b)
+    return 0;
+
+  size_t *slot = victim->tasks[t & (_QML_SLICE_DEQUE_CAP-1)];
+  *begin = __atomic_load_n(&slot[0], __ATOMIC_RELAXED);
+  *end = __atomic_load_n(&slot[1], __ATOMIC_RELAXED);
+  return __atomic_compare_exchange_n(&victim->top, &t, t+1, 0,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+typedef struct _slice_for_job {
+  slice_t           *slice;
+  size_t             grain;
+  slice_reduce_cb_t *cb;
+  void              *ctx;
+  // elements that have not been processed yet, and whether a callback asked
+  // for the loop to stop
+  size_t             remaining;
+  int                cancel;
+} _slice_for_job_t;
+
+static void _slice_for_worker(slice_workers_t *w, unsigned idx, void *arg) {
+  _slice_for_job_t *job = (_slice_for_job_t *)arg;
+  _slice_worker_t *self = &w->threads[idx];
+  unsigned rng = idx*2654435761u + 1;
+
+  for(;;) {
+    size_t begin, end;
+    if(!_slice_deque_pop(self, &begin, &end)) {
+      if(__atomic_load_n(&job->remaining, __ATOMIC_ACQUIRE) == 0
+      || __atomic_load_n(&job->cancel, __ATOMIC_RELAXED))
+        break;
+      // pick a random victim other than ourselves
+      rng ^= rng << 13;
+      rng ^= rng >> 17;
+      rng ^= rng << 5;
+      unsigned victim = rng % (w->count-1);
+      if(victim >= idx)
+        victim++;
+      if(!_slice_deque_steal(&w->threads[victim], &begin, &end)) {
+        sched_yield();
+        continue;
+      }
+    }
+
+    while(end - begin > job->grain) {
+      size_t mid = begin + (end - begin)/2;
+      if(!_slice_deque_push(self, mid, end))
+        break;
+      end = mid;
+    }
+
+    if(!__atomic_load_n(&job->cancel, __ATOMIC_RELAXED)) {
+      for(size_t i = begin; i < end; i++) {
+        if(!job->cb(job->ctx, i, job->slice->data[i])) {
+          __atomic_store_n(&job->cancel, 1, __ATOMIC_RELAXED);
+          break;
+        }
+      }
+    }
+    __atomic_fetch_sub(&job->remaining, end - begin, __ATOMIC_RELEASE);
+  }
+}
+
+int slice_parallel_for(slice_workers_t *w, slice_t *slice, size_t grain,
+                       slice_reduce_cb_t cb, void *ctx) {
+  if(grain == 0)
+    grain = slice->len / ((size_t)w->count*8);
+  if(grain == 0)
+    grain = 1;
+
+  if(w->count == 1 || slice->len <= grain) {
+    for(size_t i = 0; i < slice->len; i++)
+      if(!cb(ctx, i, slice->data[i]))
+        return 0;
+    return 1;
+  }
+
+  _slice_for_job_t job = { slice, grain, cb, ctx, slice->len, 0 };
+  // every worker is idle between jobs, so the deques can be reset directly
+  for(unsigned i = 0; i < w->count; i++) {
+    w->threads[i].top = 0;
+    w->threads[i].bottom = 0;
+  }
+  _slice_deque_push(&w->threads[0], 0, slice->len);
+
+  _slice_workers_run(w, _slice_for_worker, &job);
+  return !job.cancel;
+}
+
+// Parallel merge sort
+
+typedef struct _slice_sort_job {
+  slice_cmp_cb_t *cmp;
+  void          **src, **dst;
+  // boundaries of the sorted runs, runs+1 of them
+  size_t         *bounds;
+  size_t          runs, width;
+  size_t          next;
+} _slice_sort_job_t;
+
+static void _slice_sort_runs_worker(slice_workers_t *w, unsigned idx,
+                                    void *arg) {
+  (void)w;
+  (void)idx;
+  _slice_sort_job_t *job = (_slice_sort_job_t *)arg;
+  for(;;) {
+    size_t run = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+    if(run >= job->runs)
+      break;
+    size_t begin = job->bounds[run], end = job->bounds[run+1];
+    slice_t part = { end - begin, end - begin, job->src + begin, 0 };
+    slice_sort(&part, job->cmp);
+  }
+}
+
+// Merges pairs of runs that are job->width runs apart from src into dst.
+static void _slice_merge_runs_worker(slice_workers_t *w, unsigned idx,
+                                     void *arg) {
+  (void)w;
+  (void)idx;
+  _slice_sort_job_t *job = (_slice_sort_job_t *)arg;
+  size_t pairs = (job->runs + 2*job->width - 1) / (2*job->width);
+  for(;;) {
+    size_t pair = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+    if(pair >= pairs)
+      break;
+    size_t first = pair*2*job->width;
+    size_t mid_run = first + job->width < job->runs ? first + job->width
+                                                    : job->runs;
+    size_t last_run = first + 2*job->width < job->runs ? first + 2*job->width
+                                                       : job->runs;
+    size_t a = job->bounds[first], mid = job->bounds[mid_run];
+    size_t b = mid, end = job->bounds[last_run], out = a;
+    while(a < mid && b < end) {
+      // take from the left run on ties to keep the merge stable
+      if(job->cmp(job->src[b], job->src[a]) < 0)
+        job->dst[out++] = job->src[b++];
+      else
+        job->dst[out++] = job->src[a++];
+    }
+    memcpy(job->dst + out, job->src + a, sizeof(void*)*(mid - a));
+    out += mid - a;
+    memcpy(job->dst + out, job->src + b, sizeof(void*)*(end - b));
+  }
+}
+
+void slice_sort_parallel(slice_workers_t *w, slice_t *slice,
+                         slice_cmp_cb_t cmp) {
+  size_t len = slice->len;
+  if(w->count == 1 || len < QML_SLICE_PARALLEL_SORT_THRESHOLD) {
+    slice_sort(slice, cmp);
+    return;
+  }
+
+  size_t runs = w->count;
+  void **tmp = (void **)QML_ALLOC(sizeof(void*)*len);
+  size_t *bounds = (size_t *)QML_ALLOC(sizeof(size_t)*(runs+1));
+  if(tmp == NULL || bounds == NULL) {
+    QML_FREE(tmp);
+    QML_FREE(bounds);
+    slice_sort(slice, cmp);
+    return;
+  }
+  for(size_t i = 0; i <= runs; i++)
+    bounds[i] = len*i / runs;
+
+  // sort one run per thread, then merge them pairwise until one is left
+  _slice_sort_job_t job = { cmp, slice->data, tmp, bounds, runs, 1, 0 };
+  _slice_workers_run(w, _slice_sort_runs_worker, &job);
+  for(; job.width < runs; job.width *= 2) {
+    job.next = 0;
+    _slice_workers_run(w, _slice_merge_runs_worker, &job);
+    void **swap = job.src;
+    job.src = job.dst;
+    job.dst = swap;
+  }
+
+  if(job.src != slice->data)
+    memcpy(slice->data, job.src, sizeof(void*)*len);
+  QML_FREE(tmp);
+  QML_FREE(bounds);
+}
+
+#endif // QML_SLICE_PARALLEL_IMPLEMENTATION
@@ -0,0 +1,71 @@
+#define _GNU_SOURCE
+#define QML_SLICE_PARALLEL_IMPLEMENTATION
+#include "slice_parallel.h"
+#include <stdint.h>
+#include <stdio.h>
+
+int sum_reduce_cb(void *acc, size_t idx, void *val) {
+  (void)idx;
+  *(long *)acc += (long)(intptr_t)val;
+  return 1;
+}
+
+void sum_combine_cb(void *acc, void *part) {
+  *(long *)acc += *(long *)part;
+}
+
+int count_for_cb(void *ctx, size_t idx, void *val) {
+  (void)val;
+  // make some elements much more expensive than others
+  volatile long spin = 0;
+  for(size_t i = 0; i < (idx % 1000 == 0 ? 100000 : 0); i++)
+    spin += i;
+  __atomic_fetch_add((long *)ctx, 1, __ATOMIC_RELAXED);
+  return 1;
+}
+
+int compare_cb(void *a, void *b) {
+  intptr_t x = (intptr_t)a, y = (intptr_t)b;
+  return (x > y) - (x < y);
+}
+
+int stop_for_cb(void *ctx, size_t idx, void *val) {
+  (void)ctx;
+  (void)val;
+  return idx != 1234;
+}
+
+int main(void) {
+  // store the integers themselves in the pointers, nothing to allocate
+  slice_t my_slice = slice_alloc(1000000);
+  for(long i = 0; i < 1000000; i++)
+    slice_append(&my_slice, (void *)(intptr_t)i);
+
+  // a fixed amount of threads, so the pool is used even on a single CPU
+  slice_workers_t *workers = slice_workers_new(4);
+  long sum = 0, zero = 0;
+  slice_reduce_parallel(workers, &my_slice, &sum, &zero, sizeof(long),
+                        sum_reduce_cb, sum_combine_cb);
+  printf("Sum of integers 0-999999 is %ld.\n", sum);
+
+  long visited = 0;
+  int finished = slice_parallel_for(workers, &my_slice, 0, count_for_cb,
+                                    &visited);
+  printf("Visited %ld elements in parallel.\n", visited);
+  int stopped = !slice_parallel_for(workers, &my_slice, 0, stop_for_cb, NULL);
+  printf("Stopped early: %s\n", stopped ? "yes" : "no");
+
+  // scramble the integers, then sort them back in order
+  for(size_t i = 0; i < my_slice.len; i++)
+    my_slice.data[i] = (void *)(intptr_t)((i * 7919) % my_slice.len);
+  slice_sort_parallel(workers, &my_slice, compare_cb);
+  int sorted = 1;
+  for(size_t i = 0; i < my_slice.len; i++)
+    sorted &= (intptr_t)my_slice.data[i] == (intptr_t)i;
+  printf("Sorted in parallel: %s\n", sorted ? "yes" : "no");
+
+  slice_workers_free(workers);
+  slice_free(&my_slice);
+  return sum != 499999500000L || !finished || visited != 1000000 || !stopped
+    || !sorted;
+}
@@ -1,22 +1,938 @@
 #include "slice.h"
 #define QML_SLICE_IMPLEMENTATION
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+
+SLICE_DEFINE(int)
+
+// Prints whether a group of checks passed, and passes the result on.
+int report(const char *name, int ok) {
+  printf("%s: %s\n", name, ok ? "OK" : "FAIL");
+  return ok;
+}
+
+int is_aligned(const void *ptr, size_t align) {
+  return (uintptr_t)ptr % align == 0;
+}
+
+// xorshift, so that every run checks the same values
+uint32_t next_rand(uint32_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}
+
+// The checks below store small integers in the slices directly, as pointers.
+int cmp_ints(void *a, void *b) {
+  intptr_t x = (intptr_t)a, y = (intptr_t)b;
+  return (x > y) - (x < y);
+}
+
+// Aligned slices have to stay aligned and keep their contents through growing
+// and shrinking, all the way down to no capacity at all.
+int check_aligned(void) {
+  slice_t slice = slice_alloc_aligned(3, QML_ALIGN_CACHE_LINE);
+  int ok = is_aligned(slice.data, QML_ALIGN_CACHE_LINE);
+  for(intptr_t i = 0; i < 1000; i++)
+    slice_append(&slice, (void *)i);
+  ok = ok && is_aligned(slice.data, QML_ALIGN_CACHE_LINE);
+  slice_shrink(&slice, 0);
+  ok = ok && is_aligned(slice.data, QML_ALIGN_CACHE_LINE)
+    && slice.cap == 1000;
+  for(intptr_t i = 0; i < 1000; i++)
+    ok = ok && slice_get(&slice, i) == (void *)i;
+  // an empty slice shrunk to nothing can still grow, and be freed
+  slice.len = 0;
+  slice_shrink(&slice, 0);
+  slice_append(&slice, (void *)7);
+  ok = ok && is_aligned(slice.data, QML_ALIGN_CACHE_LINE)
+    && slice_get(&slice, 0) == (void *)7;
+  slice_free(&slice);
+  ok = ok && slice.data == NULL && slice.cap == 0;
+
+  val_slice_t vals = slice_alloc_val_aligned(sizeof(double), 1,
+                                             4096);
+  for(int i = 0; i < 1000; i++) {
+    double d = i;
+    slice_append_val(&vals, &d);
+  }
+  ok = ok && is_aligned(vals.data, 4096)
+    && *(double *)slice_get_ptr(&vals, 999) == 999.0;
+  vals.len = 0;
+  slice_shrink_val(&vals, 0);
+  slice_free_val(&vals);
+  return ok;
+}
 
 int sum_reduce_cb(void *acc, size_t idx, void *val) {
+  (void)idx;
   // memory safety? what's that??
   *(int *)acc += *(int *)val;
   return 1;
 }
 
 int free_iter_cb(size_t idx, void* val) {
+  (void)idx;
   free(val);
   return 1;
 }
 
+typedef struct record {
+  int key, seq;
+} record_t;
+
+uint64_t record_key(void *value) {
+  return (uint64_t)((record_t *)value)->key;
+}
+
+#define INT_LESS(a, b, ctx) ((a) < (b))
+SLICE_DEFINE_SORT(sort_ints, int, INT_LESS)
+
+// Sorts random values with plenty of duplicates, as well as sorted and
+// reversed runs, with every sort, checking they all agree.
+int check_sort(void) {
+  const size_t sizes[] = { 0, 1, 2, 15, 16, 17, 1000, 20000 };
+  uint32_t state = 2463534242u;
+  int ok = 1;
+  for(size_t s = 0; s < sizeof(sizes)/sizeof(sizes[0]); s++) {
+    for(int shape = 0; shape < 3; shape++) {
+      size_t n = sizes[s];
+      slice_t intro = slice_alloc(n);
+      slice_int_t typed = slice_int_alloc(n);
+      for(size_t i = 0; i < n; i++) {
+        int val = shape == 0 ? (int)(next_rand(&state) % 1000)
+          : shape == 1 ? (int)i : (int)(n - i);
+        slice_append(&intro, (void *)(intptr_t)val);
+        slice_int_append(&typed, val);
+      }
+      slice_sort(&intro, cmp_ints);
+      sort_ints(typed.data, typed.len, NULL);
+      for(size_t i = 0; i < n; i++) {
+        ok = ok && (intptr_t)intro.data[i] == typed.data[i];
+        ok = ok && (i == 0 || typed.data[i-1] <= typed.data[i]);
+      }
+      slice_free(&intro);
+      slice_int_free(&typed);
+    }
+  }
+
+  // the radix sort has to keep equal keys in the order they were in
+  record_t *records = malloc(sizeof(record_t)*20000);
+  slice_t radix = slice_alloc(20000);
+  for(int i = 0; i < 20000; i++) {
+    records[i].key = (int)(next_rand(&state) % 300) * 1000;
+    records[i].seq = i;
+    slice_append(&radix, &records[i]);
+  }
+  ok = ok && slice_sort_radix(&radix, record_key) && radix.len == 20000;
+  for(size_t i = 1; i < radix.len; i++) {
+    record_t *a = radix.data[i-1], *b = radix.data[i];
+    ok = ok && (a->key < b->key || (a->key == b->key && a->seq < b->seq));
+  }
+  slice_free(&radix);
+  free(records);
+  return ok;
+}
+
+// Fills a slice with n sorted random values below limit, duplicates included.
+slice_t sorted_ints(size_t n, int limit, uint32_t *state) {
+  slice_t slice = slice_alloc(n);
+  for(size_t i = 0; i < n; i++)
+    slice_append(&slice, (void *)(intptr_t)(next_rand(state) % limit));
+  slice_sort(&slice, cmp_ints);
+  return slice;
+}
+
+// Counts how many values of the slice are equal to the given one.
+size_t count_ints(slice_t *slice, intptr_t val) {
+  size_t count = 0;
+  for(size_t i = 0; i < slice->len; i++)
+    count += (intptr_t)slice->data[i] == val;
+  return count;
+}
+
+// Checks the searches and set operations against plain loops over the same
+// values.
+int check_search(void) {
+  uint32_t state = 88172645u;
+  int ok = 1;
+  for(size_t n = 0; n < 300; n += 37) {
+    slice_t a = sorted_ints(n, 100, &state);
+    slice_t b = sorted_ints(n/2 + 1, 100, &state);
+
+    slice_eytz_t eytz = slice_eytz_build(&a);
+    for(intptr_t val = -1; val <= 100; val++) {
+      size_t lower = 0, upper = 0;
+      while(lower < a.len && (intptr_t)a.data[lower] < val)
+        lower++;
+      while(upper < a.len && (intptr_t)a.data[upper] <= val)
+        upper++;
+      ok = ok && slice_lower_bound(&a, (void *)val, cmp_ints) == lower
+        && slice_upper_bound(&a, (void *)val, cmp_ints) == upper
+        && slice_eytz_lower_bound(&eytz, (void *)val, cmp_ints)
+             == (lower < a.len ? a.data[lower] : NULL);
+    }
+    slice_eytz_free(&eytz);
+
+    // merging keeps every value of both, and every value of b matches at most
+    // one equal value of a
+    slice_t merged = slice_alloc(1), common = slice_alloc(1),
+            only_a = slice_alloc(1);
+    slice_merge(&merged, &a, &b, cmp_ints);
+    slice_intersect(&common, &a, &b, cmp_ints);
+    slice_difference(&only_a, &a, &b, cmp_ints);
+    ok = ok && merged.len == a.len + b.len;
+    for(intptr_t val = 0; val < 100; val++) {
+      size_t in_a = count_ints(&a, val), in_b = count_ints(&b, val);
+      ok = ok && count_ints(&merged, val) == in_a + in_b
+        && count_ints(&common, val) == (in_a < in_b ? in_a : in_b)
+        && count_ints(&only_a, val) == (in_a > in_b ? in_a - in_b : 0);
+    }
+    for(size_t i = 1; i < merged.len; i++)
+      ok = ok && (intptr_t)merged.data[i-1] <= (intptr_t)merged.data[i];
+
+    // unique leaves one of every value, still in order
+    size_t len = slice_unique(&merged, cmp_ints);
+    ok = ok && len == merged.len;
+    for(size_t i = 1; i < merged.len; i++)
+      ok = ok && (intptr_t)merged.data[i-1] < (intptr_t)merged.data[i];
+    for(intptr_t val = 0; val < 100; val++)
+      ok = ok && count_ints(&merged, val)
+        == (count_ints(&a, val) + count_ints(&b, val) > 0);
+
+    slice_free(&merged);
+    slice_free(&common);
+    slice_free(&only_a);
+    slice_free(&a);
+    slice_free(&b);
+  }
+  return ok;
+}
+
+// Checks that the slice holds exactly the given values.
+int equals_ints(slice_t *slice, const intptr_t *want, size_t len) {
+  int ok = slice->len == len;
+  for(size_t i = 0; ok && i < len; i++)
+    ok = (intptr_t)slice->data[i] == want[i];
+  return ok;
+}
+
+// slice_retain has to be called with every index from before the call, in
+// order, and keeps the even values.
+size_t retain_next_idx;
+int retain_even_cb(size_t idx, void *val) {
+  if(idx != retain_next_idx++)
+    retain_next_idx = SIZE_MAX;
+  return (intptr_t)val % 2 == 0;
+}
+
+// Makes random edits to a slice and the same edits by hand to a plain array,
+// checking that they stay the same.
+int check_insert_remove(void) {
+  enum { MAX = 2000 };
+  intptr_t *want = malloc(sizeof(intptr_t)*MAX);
+  size_t len = 0;
+  uint32_t state = 521288629u;
+  intptr_t next = 0;
+  slice_t slice = slice_alloc(1);
+  int ok = 1;
+
+  for(int step = 0; ok && step < 5000; step++) {
+    size_t idx = len > 0 ? next_rand(&state) % (len + 1) : 0;
+    uint32_t op = next_rand(&state) % 6;
+    if(len + 3 > MAX)
+      op = 2;
+    if(op == 0) {
+      ok = slice_insert(&slice, idx, (void *)next);
+      memmove(want + idx + 1, want + idx, sizeof(intptr_t)*(len - idx));
+      want[idx] = next++;
+      len++;
+    } else if(op == 1) {
+      void *values[3] = { (void *)next, (void *)(next+1), (void *)(next+2) };
+      ok = slice_insert_n(&slice, idx, values, 3);
+      memmove(want + idx + 3, want + idx, sizeof(intptr_t)*(len - idx));
+      for(int i = 0; i < 3; i++)
+        want[idx + i] = next++;
+      len += 3;
+    } else if(op == 2) {
+      void *removed = slice_remove(&slice, idx);
+      if(idx == len) {
+        ok = removed == NULL;
+      } else {
+        ok = (intptr_t)removed == want[idx];
+        memmove(want + idx, want + idx + 1, sizeof(intptr_t)*(len - idx - 1));
+        len--;
+      }
+    } else if(op == 3) {
+      // the range may run past the end, only what's there is removed
+      size_t count = next_rand(&state) % 5;
+      size_t removed = idx < len && count > len - idx ? len - idx
+        : idx < len ? count : 0;
+      ok = slice_remove_range(&slice, idx, count) == removed;
+      memmove(want + idx, want + idx + removed,
+              sizeof(intptr_t)*(len - idx - removed));
+      len -= removed;
+    } else if(op == 4) {
+      void *removed = slice_swap_remove(&slice, idx);
+      if(idx == len) {
+        ok = removed == NULL;
+      } else {
+        ok = (intptr_t)removed == want[idx];
+        want[idx] = want[--len];
+      }
+    } else {
+      // out of bounds inserts change nothing
+      ok = !slice_insert(&slice, len + 1, (void *)-1)
+        && !slice_insert_n(&slice, len + 5, (void **)want, 2);
+    }
+    ok = ok && equals_ints(&slice, want, len);
+  }
+
+  size_t kept = 0;
+  for(size_t i = 0; i < len; i++)
+    if(want[i] % 2 == 0)
+      want[kept++] = want[i];
+  size_t before = slice.len;
+  retain_next_idx = 0;
+  ok = ok && slice_retain(&slice, retain_even_cb) == kept
+    && retain_next_idx == before && equals_ints(&slice, want, kept);
+
+  slice_free(&slice);
+  free(want);
+  return ok;
+}
+
+// The callbacks below are always given a slice holding 0, 1, 2..., so every
+// value has to match it's index.
+int map_saw_wrong_idx;
+
+void *triple_map_cb(size_t idx, void *val) {
+  map_saw_wrong_idx |= (intptr_t)val != (intptr_t)idx;
+  return (void *)((intptr_t)val * 3);
+}
+
+int thirds_filter_cb(size_t idx, void *val) {
+  map_saw_wrong_idx |= (intptr_t)val != (intptr_t)idx;
+  return (intptr_t)val % 3 == 0;
+}
+
+int odd_tenfold_cb(size_t idx, void *val, void **out) {
+  map_saw_wrong_idx |= (intptr_t)val != (intptr_t)idx;
+  if((intptr_t)val % 2 == 0)
+    return 0;
+  *out = (void *)((intptr_t)val * 10);
+  return 1;
+}
+
+// Fills a slice with 0 to n-1.
+slice_t counting_ints(size_t n) {
+  slice_t slice = slice_alloc(1);
+  for(size_t i = 0; i < n; i++)
+    slice_append(&slice, (void *)(intptr_t)i);
+  return slice;
+}
+
+// Maps and filters into slices that already hold a value, which has to stay
+// in front of the results, and then does the same in place.
+int check_map_filter(void) {
+  int ok = 1;
+  map_saw_wrong_idx = 0;
+  for(size_t n = 0; n < 100; n += 7) {
+    slice_t in = counting_ints(n);
+    slice_t mapped = slice_alloc(1), filtered = slice_alloc(1),
+            filter_mapped = slice_alloc(1);
+    slice_append(&mapped, (void *)-1);
+    slice_append(&filtered, (void *)-1);
+    slice_append(&filter_mapped, (void *)-1);
+    slice_map(&mapped, &in, triple_map_cb);
+    slice_filter(&filtered, &in, thirds_filter_cb);
+    slice_filter_map(&filter_mapped, &in, odd_tenfold_cb);
+
+    ok = ok && mapped.len == n + 1 && filtered.len == 1 + (n + 2)/3
+      && filter_mapped.len == 1 + n/2
+      && mapped.data[0] == (void *)-1 && filtered.data[0] == (void *)-1
+      && filter_mapped.data[0] == (void *)-1;
+    for(size_t i = 1; ok && i < mapped.len; i++)
+      ok = (intptr_t)mapped.data[i] == (intptr_t)(i - 1)*3;
+    for(size_t i = 1; ok && i < filtered.len; i++)
+      ok = (intptr_t)filtered.data[i] == (intptr_t)(i - 1)*3;
+    for(size_t i = 1; ok && i < filter_mapped.len; i++)
+      ok = (intptr_t)filter_mapped.data[i] == (intptr_t)(2*i - 1)*10;
+    // the input is left as it was
+    ok = ok && in.len == n;
+    for(size_t i = 0; ok && i < n; i++)
+      ok = (intptr_t)in.data[i] == (intptr_t)i;
+
+    slice_map_in_place(&in, triple_map_cb);
+    for(size_t i = 0; ok && i < n; i++)
+      ok = (intptr_t)in.data[i] == (intptr_t)i*3;
+    slice_free(&in);
+
+    in = counting_ints(n);
+    ok = ok && slice_filter_map_in_place(&in, odd_tenfold_cb) == n/2
+      && in.len == n/2;
+    for(size_t i = 0; ok && i < in.len; i++)
+      ok = (intptr_t)in.data[i] == (intptr_t)(2*i + 1)*10;
+
+    slice_free(&in);
+    slice_free(&mapped);
+    slice_free(&filtered);
+    slice_free(&filter_mapped);
+  }
+  return ok && !map_saw_wrong_idx;
+}
+
+// Reserved room has to be usable without the slice moving, and the bulk
+// appends have to land after what's already there, even when a slice is
+// extended with itself.
+int check_extend(void) {
+  int ok = 1;
+  slice_t slice = slice_alloc(1);
+  for(size_t amt = 1; amt < 2000; amt *= 3) {
+    slice_reserve(&slice, amt);
+    void **data = slice.data;
+    size_t cap = slice.cap;
+    for(size_t i = 0; i < amt; i++)
+      slice_append(&slice, (void *)(intptr_t)i);
+    ok = ok && slice.data == data && slice.cap == cap;
+  }
+  slice_free(&slice);
+
+  slice = counting_ints(5);
+  void *values[100];
+  for(intptr_t i = 0; i < 100; i++)
+    values[i] = (void *)(i + 5);
+  slice_extend(&slice, values, 100);
+  slice_extend(&slice, values, 0);
+  ok = ok && slice.len == 105;
+  for(size_t i = 0; ok && i < slice.len; i++)
+    ok = (intptr_t)slice.data[i] == (intptr_t)i;
+
+  slice_t other = counting_ints(3);
+  slice_extend_slice(&other, &slice);
+  ok = ok && other.len == 108 && (intptr_t)other.data[2] == 2;
+  for(size_t i = 3; ok && i < other.len; i++)
+    ok = (intptr_t)other.data[i] == (intptr_t)i - 3;
+  slice_free(&other);
+
+  // shrunk to fit, extending with itself has to grow and copy from the moved
+  // data
+  slice_shrink(&slice, 0);
+  slice_extend_slice(&slice, &slice);
+  ok = ok && slice.len == 210;
+  for(size_t i = 0; ok && i < slice.len; i++)
+    ok = (intptr_t)slice.data[i] == (intptr_t)(i % 105);
+
+  slice_append_n_null(&slice, 50);
+  slice_append(&slice, (void *)7);
+  ok = ok && slice.len == 261 && slice.data[260] == (void *)7;
+  for(size_t i = 210; ok && i < 260; i++)
+    ok = slice.data[i] == NULL;
+  slice_free(&slice);
+  return ok;
+}
+
+// Sums the values and checks they're visited in increasing index order, every
+// value being it's own index plus one.
+typedef struct sparse_sum {
+  size_t count, last_idx;
+  intptr_t sum;
+  int ok;
+} sparse_sum_t;
+
+int sparse_sum_reduce_cb(void *acc, size_t idx, void *val) {
+  sparse_sum_t *sum = acc;
+  sum->ok = sum->ok && (sum->count == 0 || idx > sum->last_idx)
+    && (intptr_t)val == (intptr_t)idx + 1;
+  sum->count++;
+  sum->last_idx = idx;
+  sum->sum += (intptr_t)val;
+  return 1;
+}
+
+size_t sparse_iter_calls;
+int sparse_stop_iter_cb(size_t idx, void *val) {
+  (void)idx;
+  (void)val;
+  sparse_iter_calls++;
+  return sparse_iter_calls < 3;
+}
+
+// Sets values at indices spread far apart in a zeroed sparse slice, reading
+// them back along with their unset neighbours, and checks slice_set fills the
+// gap when it's given an index far past a slice's capacity.
+int check_sparse(void) {
+  const size_t idxs[] = { 0, 1, 511, 512, 5000, 70000, 1 << 20 };
+  const size_t count = sizeof(idxs)/sizeof(idxs[0]);
+  slice_sparse_t sparse = {0};
+  int ok = slice_sparse_get(&sparse, 0) == NULL && sparse.len == 0;
+
+  intptr_t want_sum = 0;
+  for(size_t i = 0; i < count; i++) {
+    slice_sparse_set(&sparse, idxs[i], (void *)(intptr_t)(idxs[i] + 1));
+    want_sum += idxs[i] + 1;
+  }
+  ok = ok && sparse.len == idxs[count-1] + 1;
+  for(size_t i = 0; i < count; i++)
+    ok = ok && slice_sparse_get(&sparse, idxs[i])
+                 == (void *)(intptr_t)(idxs[i] + 1)
+      && slice_sparse_get(&sparse, idxs[i] + 2) == NULL;
+  ok = ok && slice_sparse_get(&sparse, 3000) == NULL
+    && slice_sparse_get(&sparse, (size_t)1 << 40) == NULL;
+
+  // NULL past every page extends the length, but allocates nothing
+  size_t pages = sparse.pages.len;
+  slice_sparse_set(&sparse, (size_t)1 << 22, NULL);
+  ok = ok && sparse.len == ((size_t)1 << 22) + 1 && sparse.pages.len == pages;
+  // and clearing a value leaves it out of iteration
+  slice_sparse_set(&sparse, 5000, NULL);
+  want_sum -= 5001;
+  ok = ok && slice_sparse_get(&sparse, 5000) == NULL;
+
+  sparse_sum_t sum = { 0, 0, 0, 1 };
+  slice_sparse_reduce(&sparse, &sum, sparse_sum_reduce_cb);
+  ok = ok && sum.ok && sum.count == count - 1 && sum.sum == want_sum;
+  sparse_iter_calls = 0;
+  slice_sparse_iter(&sparse, sparse_stop_iter_cb);
+  ok = ok && sparse_iter_calls == 3;
+
+  slice_sparse_free(&sparse);
+  ok = ok && sparse.len == 0 && slice_sparse_get(&sparse, 0) == NULL;
+
+  // slice_set used to grow by idx - cap, too little for an index just past the
+  // capacity of a mostly empty slice
+  slice_t slice = slice_alloc(100);
+  slice_append(&slice, (void *)1);
+  slice_set(&slice, 150, (void *)2);
+  ok = ok && slice.len == 151 && slice.cap > 150
+    && slice.data[0] == (void *)1 && slice.data[150] == (void *)2;
+  for(size_t i = 1; ok && i < 150; i++)
+    ok = slice.data[i] == NULL;
+  slice_set(&slice, 5000, (void *)3);
+  slice_set(&slice, 70, (void *)4);
+  ok = ok && slice.len == 5001 && slice.data[5000] == (void *)3
+    && slice.data[70] == (void *)4 && slice.data[4999] == NULL;
+  slice_free(&slice);
+  return ok;
+}
+
+SLICE_DEFINE_HEAP(heap4_ints, int, INT_LESS, 4)
+
+// Checks that no value of a heap with the given arity comes before it's
+// parent.
+int is_heap(slice_t *slice, size_t arity) {
+  for(size_t i = 1; i < slice->len; i++)
+    if(cmp_ints(slice->data[i], slice->data[(i-1) / arity]) < 0)
+      return 0;
+  return 1;
+}
+
+// Builds heaps from random values, pushing more and decreasing some of them
+// along the way, and checks every value comes back out in sorted order.
+int check_heap(void) {
+  uint32_t state = 1234567u;
+  int ok = 1;
+  for(size_t n = 0; n < 500; n += 61) {
+    slice_t heap = slice_alloc(1), all = slice_alloc(1);
+    for(size_t i = 0; i < n; i++)
+      slice_append(&heap, (void *)(intptr_t)(next_rand(&state) % 1000));
+    slice_heapify(&heap, cmp_ints);
+    ok = ok && is_heap(&heap, QML_SLICE_HEAP_ARITY);
+    for(size_t i = 0; i < n; i++)
+      slice_heap_push(&heap, (void *)(intptr_t)(next_rand(&state) % 1000),
+                      cmp_ints);
+    for(size_t i = 0; i < n/4; i++) {
+      size_t idx = next_rand(&state) % heap.len;
+      intptr_t val = (intptr_t)heap.data[idx];
+      slice_heap_decrease(&heap, idx,
+                          (void *)(val - (intptr_t)(next_rand(&state) % 100)),
+                          cmp_ints);
+    }
+    // out of bounds does nothing
+    slice_heap_decrease(&heap, heap.len, (void *)-1, cmp_ints);
+    ok = ok && heap.len == 2*n && is_heap(&heap, QML_SLICE_HEAP_ARITY);
+
+    slice_extend_slice(&all, &heap);
+    slice_sort(&all, cmp_ints);
+    for(size_t i = 0; ok && i < all.len; i++)
+      ok = slice_heap_pop(&heap, cmp_ints) == all.data[i]
+        && heap.len == all.len - i - 1;
+    ok = ok && slice_heap_pop(&heap, cmp_ints) == NULL && heap.len == 0;
+    slice_free(&heap);
+    slice_free(&all);
+
+    // the same with a typed 4-ary heap, checked against the typed sort, half of
+    // it heapified at once and the rest pushed
+    slice_int_t typed = slice_int_alloc(1), sorted = slice_int_alloc(1);
+    for(size_t i = 0; i < n; i++) {
+      int val = (int)(next_rand(&state) % 1000);
+      slice_int_append(&typed, val);
+      slice_int_append(&sorted, val);
+      if(i == n/2)
+        heap4_ints_heapify(typed.data, typed.len, NULL);
+      else if(i > n/2)
+        heap4_ints_push(typed.data, typed.len, NULL);
+    }
+    if(typed.len > 0) {
+      // decrease the value in the last node, and the same value in the copy
+      size_t idx = 0;
+      while(sorted.data[idx] != typed.data[typed.len-1])
+        idx++;
+      sorted.data[idx] -= 50;
+      typed.data[typed.len-1] -= 50;
+      heap4_ints_sift_up(typed.data, typed.len-1, NULL);
+    }
+    sort_ints(sorted.data, sorted.len, NULL);
+    for(size_t i = 0; ok && i < sorted.len; i++) {
+      heap4_ints_pop(typed.data, typed.len, NULL);
+      ok = typed.data[--typed.len] == sorted.data[i];
+    }
+    slice_int_free(&typed);
+    slice_int_free(&sorted);
+  }
+  return ok;
+}
+
+// Collects the values slice_deque_iter visits, checking the indices count up
+// from 0.
+intptr_t deque_seen[4096];
+size_t deque_seen_len;
+int deque_collect_cb(size_t idx, void *val) {
+  if(idx != deque_seen_len)
+    return 0;
+  deque_seen[deque_seen_len++] = (intptr_t)val;
+  return 1;
+}
+
+// Checks the deque holds the same values as want[0..len-1], front to back,
+// both through slice_deque_get and slice_deque_iter.
+int deque_equals(slice_deque_t *deque, const intptr_t *want, size_t len) {
+  int ok = deque->len == len;
+  deque_seen_len = 0;
+  slice_deque_iter(deque, deque_collect_cb);
+  ok = ok && deque_seen_len == len;
+  for(size_t i = 0; ok && i < len; i++)
+    ok = (intptr_t)slice_deque_get(deque, i) == want[i]
+      && deque_seen[i] == want[i];
+  return ok && slice_deque_get(deque, len) == NULL;
+}
+
+// Pushes and pops at random ends of a deque, and the same on a plain array
+// with room on both sides, checking the order matches after every step. Then
+// keeps a full deque's length fixed while the values go round the ring
+// several times, so that it wraps without growing.
+int check_deque(void) {
+  enum { MAX = 4096 };
+  intptr_t *want = malloc(sizeof(intptr_t)*MAX*2);
+  size_t head = MAX, len = 0;
+  uint32_t state = 3141592653u;
+  intptr_t next = 1;
+  slice_deque_t deque = slice_deque_alloc(4);
+  int ok = 1;
+
+  for(int step = 0; ok && step < 3000; step++) {
+    uint32_t op = next_rand(&state) % 5;
+    if(op == 0 || (op == 4 && len < MAX - 1)) {
+      slice_push_front(&deque, (void *)next);
+      want[--head] = next++;
+      len++;
+    } else if(op == 1 && len < MAX - 1) {
+      slice_push_back(&deque, (void *)next);
+      want[head + len++] = next++;
+    } else if(op == 2) {
+      void *val = slice_pop_front(&deque);
+      ok = len == 0 ? val == NULL : (intptr_t)val == want[head++];
+      len -= len > 0;
+    } else {
+      void *val = slice_pop_back(&deque);
+      ok = len == 0 ? val == NULL : (intptr_t)val == want[head + --len];
+    }
+    ok = ok && deque_equals(&deque, want + head, len);
+  }
+  slice_deque_free(&deque);
+
+  // 8 values in a ring of 8, rotated one at a time in both directions
+  deque = slice_deque_alloc(8);
+  for(intptr_t i = 0; i < 8; i++)
+    slice_push_back(&deque, (void *)i);
+  for(int step = 0; ok && step < 20; step++) {
+    slice_push_back(&deque, slice_pop_front(&deque));
+    ok = deque.cap == 8;
+    for(size_t i = 0; ok && i < 8; i++)
+      want[i] = (intptr_t)((i + step + 1) % 8);
+    ok = ok && deque_equals(&deque, want, 8);
+  }
+  for(int step = 0; ok && step < 20; step++)
+    slice_push_front(&deque, slice_pop_back(&deque));
+  for(size_t i = 0; ok && i < 8; i++)
+    want[i] = (intptr_t)i;
+  ok = ok && deque.cap == 8 && deque_equals(&deque, want, 8);
+  // growing while wrapped has to keep the order
+  slice_push_front(&deque, (void *)-1);
+  slice_push_back(&deque, (void *)8);
+  ok = ok && (intptr_t)slice_deque_get(&deque, 0) == -1;
+  for(size_t i = 1; ok && i < 10; i++)
+    ok = (intptr_t)slice_deque_get(&deque, i) == (intptr_t)i - 1;
+  slice_deque_free(&deque);
+  free(want);
+  return ok;
+}
+
+// Counts the values visited, as long as they come in order and every one is
+// it's own index.
+size_t seg_in_order;
+int seg_in_order_cb(size_t idx, void *val) {
+  if(idx != seg_in_order || (intptr_t)val != (intptr_t)idx)
+    return 0;
+  seg_in_order++;
+  return 1;
+}
+
+// Appends to a segmented slice past several block boundaries, checking after
+// each one that the addresses taken with slice_seg_at before it still hold
+// the same values, and are still the addresses of those indices.
+int check_seg(void) {
+  enum { COUNT = 5000 };
+  void ***addrs = malloc(sizeof(void**)*COUNT);
+  slice_seg_t seg = {0};
+  int ok = slice_seg_at(&seg, 0) == NULL && slice_seg_get(&seg, 0) == NULL;
+  for(intptr_t i = 0; ok && i < COUNT; i++) {
+    slice_seg_append(&seg, (void *)i);
+    addrs[i] = slice_seg_at(&seg, i);
+    ok = addrs[i] != NULL && *addrs[i] == (void *)i;
+    // the first index of a block, every earlier address has to be unchanged
+    if(i > 0 && (i & (i + QML_SLICE_SEG_FIRST)) == 0)
+      for(intptr_t j = 0; ok && j < i; j++)
+        ok = slice_seg_at(&seg, j) == addrs[j] && *addrs[j] == (void *)j;
+  }
+  // 64 + 128 + ... + 4096 is 8128, so 7 blocks are in use
+  size_t blocks = 0;
+  for(size_t b = 0; b < QML_SLICE_SEG_BLOCKS; b++)
+    blocks += seg.blocks[b] != NULL;
+  ok = ok && seg.len == COUNT && blocks == 7
+    && slice_seg_get(&seg, COUNT - 1) == (void *)(COUNT - 1)
+    && slice_seg_get(&seg, COUNT) == NULL && slice_seg_at(&seg, COUNT) == NULL;
+
+  // writing through an address is seen by slice_seg_get
+  *addrs[100] = (void *)-100;
+  ok = ok && slice_seg_get(&seg, 100) == (void *)-100;
+  *addrs[100] = (void *)100;
+  seg_in_order = 0;
+  slice_seg_iter(&seg, seg_in_order_cb);
+  ok = ok && seg_in_order == COUNT;
+
+  slice_seg_free(&seg);
+  ok = ok && seg.len == 0 && slice_seg_get(&seg, 0) == NULL;
+  free(addrs);
+  return ok;
+}
+
+// Counts the blocks a pool has allocated, following the link at the start of
+// each one.
+size_t pool_blocks(slice_pool_t *pool) {
+  size_t count = 0;
+  for(char *block = pool->block; block != NULL; block = *(char **)block)
+    count++;
+  return count;
+}
+
+// Takes objects from a pool across a few blocks, releases some and takes them
+// again, checking the released ones come back, most recent first, without the
+// pool allocating anything, and that no two objects overlap.
+int check_pool(void) {
+  enum { COUNT = 20 };
+  slice_pool_t pool = slice_pool_alloc(sizeof(int), 8);
+  int *objs[COUNT];
+  int ok = pool.block == NULL;
+  for(int i = 0; i < COUNT; i++) {
+    objs[i] = slice_pool_obj(&pool);
+    ok = ok && objs[i] != NULL && is_aligned(objs[i], sizeof(void*));
+    *objs[i] = i;
+  }
+  ok = ok && pool_blocks(&pool) == 3;
+
+  char *block = pool.block;
+  size_t used = pool.used;
+  slice_pool_release(&pool, objs[3]);
+  slice_pool_release(&pool, objs[7]);
+  slice_pool_release(&pool, objs[15]);
+  ok = ok && slice_pool_obj(&pool) == objs[15]
+    && slice_pool_obj(&pool) == objs[7] && slice_pool_obj(&pool) == objs[3];
+  ok = ok && pool.block == block && pool.used == used && pool.free_list == NULL;
+  for(int i = 0; i < COUNT; i++)
+    *objs[i] = -i;
+
+  // with nothing left to reuse the rest of the newest block is handed out, and
+  // then a new one is allocated
+  for(size_t i = used; ok && i < pool.block_cap; i++) {
+    int *obj = slice_pool_obj(&pool);
+    ok = obj != NULL && pool.block == block;
+    *obj = 100;
+  }
+  ok = ok && slice_pool_obj(&pool) != NULL && pool_blocks(&pool) == 4;
+  for(int i = 0; ok && i < COUNT; i++)
+    ok = *objs[i] == -i;
+
+  slice_pool_free(&pool);
+  ok = ok && pool.block == NULL && pool.free_list == NULL;
+  // a freed pool can be used again
+  ok = ok && slice_pool_obj(&pool) != NULL && pool_blocks(&pool) == 1;
+  slice_pool_free(&pool);
+  return ok;
+}
+
+// An element size that isn't a power of two.
+typedef struct triple {
+  int a, b, c;
+} triple_t;
+
+// Overwrites an element of a value slice in place, then sets one far past it's
+// capacity, checking the elements in between are zeroed and the others kept.
+int check_set_val(void) {
+  val_slice_t triples = slice_alloc_val(sizeof(triple_t), 4);
+  for(int i = 0; i < 3; i++) {
+    triple_t t = { i, i, i };
+    slice_append_val(&triples, &t);
+  }
+  triple_t replaced = { 10, 20, 30 }, far = { 7, 8, 9 };
+  slice_set_val(&triples, 1, &replaced);
+  int ok = triples.len == 3;
+  slice_set_val(&triples, 200, &far);
+  ok = ok && triples.len == 201 && triples.cap > 200
+    && slice_get_ptr(&triples, 201) == NULL;
+
+  triple_t *first = slice_get_ptr(&triples, 0);
+  triple_t *second = slice_get_ptr(&triples, 1);
+  triple_t *third = slice_get_ptr(&triples, 2);
+  triple_t *last = slice_get_ptr(&triples, 200);
+  ok = ok && first->a == 0 && second->b == 20 && third->c == 2
+    && last->a == 7 && last->c == 9;
+  for(size_t i = 3; ok && i < 200; i++) {
+    triple_t *t = slice_get_ptr(&triples, i);
+    ok = t->a == 0 && t->b == 0 && t->c == 0;
+  }
+  slice_free_val(&triples);
+  return ok;
+}
+
+// Runs the untyped loop macros to the end, with continue, and with an early
+// break, which has to leave the loop right away rather than finish the
+// element it's in. Nested loops need their own index names.
+int check_foreach(void) {
+  slice_t ptrs = counting_ints(100);
+  val_slice_t vals = slice_alloc_val(sizeof(int), 1);
+  for(int i = 0; i < 100; i++)
+    slice_append_val(&vals, &i);
+  int ok = 1;
+
+  intptr_t sum = 0;
+  size_t visited = 0;
+  SLICE_FOREACH(&ptrs, i, val) {
+    ok = ok && (intptr_t)val == (intptr_t)i;
+    if(i % 2)
+      continue;
+    sum += (intptr_t)val;
+    visited++;
+  }
+  ok = ok && sum == 2450 && visited == 50;
+
+  size_t stopped_at = 0;
+  visited = 0;
+  SLICE_FOREACH(&ptrs, i, val) {
+    if((intptr_t)val == 42) {
+      stopped_at = i;
+      break;
+    }
+    visited++;
+  }
+  ok = ok && stopped_at == 42 && visited == 42;
+
+  long val_sum = 0;
+  SLICE_FOREACH_VAL(&vals, i, int, val) {
+    ok = ok && *val == (int)i;
+    *val *= 2;
+    val_sum += *val;
+  }
+  ok = ok && val_sum == 9900 && *(int *)slice_get_ptr(&vals, 99) == 198;
+
+  visited = 0;
+  SLICE_FOREACH_VAL(&vals, i, int, val) {
+    if(*val >= 20)
+      break;
+    visited++;
+  }
+  ok = ok && visited == 10;
+
+  // the inner break only leaves the inner loop
+  size_t pairs = 0;
+  SLICE_FOREACH(&ptrs, i, outer) {
+    if((intptr_t)outer == 10)
+      break;
+    SLICE_FOREACH_VAL(&vals, j, int, inner) {
+      if(*inner > 2*(intptr_t)outer)
+        break;
+      pairs++;
+    }
+  }
+  ok = ok && pairs == 55;
+
+  slice_free(&ptrs);
+  slice_free_val(&vals);
+  return ok;
+}
+
+// Sets typed elements past the end, over memory that held other values first,
+// reserves room and checks appends then don't move the data, and shrinks
+// down to the length before appending again.
+int check_typed(void) {
+  slice_int_t typed = slice_int_alloc(4);
+  int ok = 1;
+
+  for(int i = 0; i < 64; i++)
+    slice_int_append(&typed, -1);
+  typed.len = 2;
+  slice_int_set(&typed, 40, 40);
+  slice_int_set(&typed, 100, 100);
+  ok = ok && typed.len == 101 && typed.cap >= 101;
+  for(size_t i = 2; i < typed.len; i++)
+    ok = ok && typed.data[i] == (i == 40 || i == 100 ? (int)i : 0);
+  ok = ok && typed.data[0] == -1 && slice_int_get(&typed, 101) == NULL;
+  // setting inside the length doesn't change it
+  slice_int_set(&typed, 3, 3);
+  ok = ok && typed.len == 101 && *slice_int_get(&typed, 3) == 3;
+
+  slice_int_reserve(&typed, 500);
+  int *data = typed.data;
+  ok = ok && typed.cap >= 601;
+  for(int i = 0; i < 500; i++)
+    slice_int_append(&typed, i);
+  ok = ok && typed.data == data && typed.len == 601;
+
+  typed.len = 10;
+  slice_int_shrink(&typed, 0);
+  ok = ok && typed.cap == 10 && typed.data[3] == 3 && typed.data[9] == 0;
+  for(int i = 10; i < 100; i++)
+    slice_int_append(&typed, i);
+  ok = ok && typed.len == 100 && typed.cap >= 100 && typed.data[3] == 3;
+  for(int i = 10; i < 100; i++)
+    ok = ok && typed.data[i] == i;
+
+  // shrinking an empty slice still leaves room for one element
+  typed.len = 0;
+  slice_int_shrink(&typed, 0);
+  slice_int_append(&typed, 7);
+  ok = ok && typed.cap >= 1 && typed.len == 1 && typed.data[0] == 7;
+
+  slice_int_free(&typed);
+  return ok && typed.data == NULL && typed.cap == 0;
+}
+
 // this entire program can be rewritten with just an array
 // but it's better than nothing
-int main(int argc, char* argv[]) {
+int main(void) {
   // allocate a slice for 100 integers
   slice_t my_slice = slice_alloc(100);
   // allocate 100 integers and place them in the slice
@@ -32,4 +948,85 @@ int main(int argc, char* argv[]) {
   printf("Sum of integers 0-99 is %d.\n", sum);
   // use slice_iter to free all the allocated memory
   slice_iter(&my_slice, free_iter_cb);
+  slice_free(&my_slice);
+
+  // the same thing with a value slice, which stores the integers directly
+  val_slice_t my_ints = slice_alloc_val(sizeof(int), 100);
+  for(int i = 0; i < 100; i++)
+    slice_append_val(&my_ints, &i);
+  sum = 0;
+  slice_reduce_val(&my_ints, &sum, sum_reduce_cb);
+  printf("Sum of integers 0-99 is %d.\n", sum);
+  // nothing to free but the slice itself
+  slice_free_val(&my_ints);
+
+  // and once more with a typed slice, where the loop can be inlined
+  slice_int_t typed_ints = slice_int_alloc(100);
+  for(int i = 0; i < 100; i++)
+    slice_int_append(&typed_ints, i);
+  sum = 0;
+  SLICE_FOREACH_TYPED(&typed_ints, i, int, val)
+    sum += *val;
+  printf("Sum of integers 0-99 is %d.\n", sum);
+  slice_int_free(&typed_ints);
+
+  // and with a deque, pushing the integers to alternating ends
+  slice_deque_t my_deque = slice_deque_alloc(4);
+  for(int i = 0; i < 100; i++) {
+    int* some_int = malloc(sizeof(int));
+    *some_int = i;
+    if(i % 2)
+      slice_push_front(&my_deque, some_int);
+    else
+      slice_push_back(&my_deque, some_int);
+  }
+  sum = 0;
+  slice_deque_reduce(&my_deque, &sum, sum_reduce_cb);
+  printf("Sum of integers 0-99 is %d.\n", sum);
+  slice_deque_iter(&my_deque, free_iter_cb);
+  slice_deque_free(&my_deque);
+
+  // and with a segmented slice, which never copies when it grows
+  slice_seg_t my_seg = {0};
+  for(int i = 0; i < 100; i++) {
+    int* some_int = malloc(sizeof(int));
+    *some_int = i;
+    slice_seg_append(&my_seg, some_int);
+  }
+  sum = 0;
+  slice_seg_reduce(&my_seg, &sum, sum_reduce_cb);
+  printf("Sum of integers 0-99 is %d.\n", sum);
+  slice_seg_iter(&my_seg, free_iter_cb);
+  slice_seg_free(&my_seg);
+
+  // and with the integers taken from a pool, which frees them all at once
+  slice_t pooled_slice = slice_alloc(100);
+  slice_pool_t pool = slice_pool_alloc(sizeof(int), 64);
+  for(int i = 0; i < 100; i++) {
+    int* some_int = slice_pool_obj(&pool);
+    *some_int = i;
+    slice_append(&pooled_slice, some_int);
+  }
+  sum = 0;
+  slice_reduce(&pooled_slice, &sum, sum_reduce_cb);
+  printf("Sum of integers 0-99 is %d.\n", sum);
+  slice_free_with_pool(&pooled_slice, &pool);
+
+  // the checks below exit non-zero if anything is off
+  int ok = 1;
+  ok &= report("Aligned slices", check_aligned());
+  ok &= report("Sorting", check_sort());
+  ok &= report("Searching and set operations", check_search());
+  ok &= report("Inserting and removing", check_insert_remove());
+  ok &= report("Mapping and filtering", check_map_filter());
+  ok &= report("Reserving and extending", check_extend());
+  ok &= report("Sparse slices", check_sparse());
+  ok &= report("Heaps", check_heap());
+  ok &= report("Deques", check_deque());
+  ok &= report("Segmented slices", check_seg());
+  ok &= report("Object pools", check_pool());
+  ok &= report("Setting value slice elements", check_set_val());
+  ok &= report("Untyped loop macros", check_foreach());
+  ok &= report("Typed slices", check_typed());
+  return !ok;
 }